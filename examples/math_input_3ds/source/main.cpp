@@ -21,6 +21,7 @@
 #include <cstring>
 #include <iostream>
 #include <ranges>
+#include <seshat/recognizer.hpp>
 #include <seshat/seshat.hpp>
 
 struct color_t {
@@ -202,11 +203,12 @@ static void work3DS()
     bool handled_last_draw = true;
     seshat::sample s;
     seshat::math_expression recog("romfs:/CONFIG");
+    // parses on a worker thread so drawing never waits for it
+    seshat::async_recognizer worker(recog);
 
     gfxSetDoubleBuffering(GFX_BOTTOM, false);
     u8* const fb = gfxGetFramebuffer(GFX_BOTTOM, GFX_LEFT, nullptr, nullptr);
     fbFill(fb, { 255, 255, 255, 255 });
-    std::vector<seshat::hypothesis> hyps;
 
     // Event loop
     while (!quit) {
@@ -283,12 +285,20 @@ static void work3DS()
             handled_last_draw = true;
 
             printf("Parsing %zd strokes with %zd total points\n", s.strokes.size(), s.total_points);
-            hyps.clear();
             std::cerr << "Starting a big think at " << std::chrono::system_clock::now() << std::endl;
-            recog.parse_sample(s, hyps);
+            worker.submit(s);
+        }
+        if (auto res = worker.take()) {
             std::cerr << "Done with thinking at " << std::chrono::system_clock::now() << std::endl;
-            printf("Found %zd hypothesis\n", hyps.size());
-            for (const auto& hyp : hyps) {
+            if (res->error) {
+                try {
+                    std::rethrow_exception(res->error);
+                } catch (const std::exception& ex) {
+                    printf("Parsing failed: %s\n", ex.what());
+                }
+            }
+            printf("Found %zd hypothesis\n", res->hypotheses.size());
+            for (const auto& hyp : res->hypotheses) {
 #ifdef SESHAT_HYPOTHESIS_TREE
                 if (hyp.tokens.empty())
                     continue;
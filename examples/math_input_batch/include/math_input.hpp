@@ -0,0 +1,222 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <seshat/corpus.hpp>
+#include <seshat/seshat.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+#ifdef _WIN32
+#include <sstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole file, memory mapped where possible
+class MappedFile {
+    const char* data{ nullptr };
+    std::size_t size{ 0 };
+#ifdef _WIN32
+    std::string contents;
+#endif
+
+public:
+    explicit MappedFile(const char* path)
+    {
+#ifdef _WIN32
+        std::ifstream fd(path, std::ios::binary);
+        if (!fd)
+            return;
+        std::ostringstream ss;
+        ss << fd.rdbuf();
+        contents = std::move(ss).str();
+        data = contents.data();
+        size = contents.size();
+#else
+        const int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                data = static_cast<const char*>(p);
+                size = st.st_size;
+            }
+        }
+        close(fd);
+#endif
+    }
+    ~MappedFile()
+    {
+#ifndef _WIN32
+        if (data)
+            munmap(const_cast<char*>(data), size);
+#endif
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    explicit operator bool() const
+    {
+        return data != nullptr;
+    }
+    std::string_view view() const
+    {
+        return { data, size };
+    }
+};
+
+// Whitespace separated numbers, read with from_chars
+class Tokenizer {
+    const char* pos;
+    const char* end;
+
+    void skip()
+    {
+        while (pos != end && (*pos == ' ' || *pos == '\t' || *pos == '\r' || *pos == '\n'))
+            ++pos;
+    }
+
+public:
+    explicit Tokenizer(std::string_view text)
+        : pos{ text.data() }
+        , end{ text.data() + text.size() }
+    {
+    }
+
+    template <typename T>
+    bool next(T& value)
+    {
+        skip();
+        // from_chars doesn't accept a leading '+'
+        if (pos != end && *pos == '+')
+            ++pos;
+        const auto [ptr, ec] = std::from_chars(pos, end, value);
+        if (ec != std::errc{})
+            return false;
+        pos = ptr;
+        return true;
+    }
+};
+
+static seshat::sample loadSCGInk(const char* path)
+{
+    seshat::sample out;
+
+    const MappedFile file(path);
+    if (!file) {
+        std::cerr << "Error loading SCGInk file '" << path << "'\n";
+        return out;
+    }
+
+    std::string_view text = file.view();
+    const auto eol = text.find('\n');
+    std::string_view magic = text.substr(0, eol);
+    if (!magic.empty() && magic.back() == '\r')
+        magic.remove_suffix(1);
+    if (magic != "SCG_INK") {
+        std::cerr << "Error: input file format is not SCG_INK: " << magic << "\n";
+        return out;
+    }
+    text.remove_prefix(eol == std::string_view::npos ? text.size() : eol + 1);
+
+    Tokenizer tok(text);
+    int nstrokes, npoints;
+    if (!tok.next(nstrokes) || nstrokes < 0) {
+        std::cerr << "Error: bad stroke count in '" << path << "'\n";
+        return out;
+    }
+    out.strokes.resize(nstrokes);
+    for (auto& out_stroke : out.strokes) {
+        if (!tok.next(npoints) || npoints < 0) {
+            std::cerr << "Error: bad point count in '" << path << "'\n";
+            return {};
+        }
+        out_stroke.points.resize(npoints);
+        for (auto& out_point : out_stroke.points) {
+            if (!tok.next(out_point.x) || !tok.next(out_point.y)) {
+                std::cerr << "Error: bad point in '" << path << "'\n";
+                return {};
+            }
+        }
+        out.total_points += npoints;
+    }
+
+    return out;
+}
+
+// Quoted JSON string
+static void writeJSON(std::string& out, std::string_view str)
+{
+    out += '"';
+    for (const char c : str) {
+        switch (c) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            } else {
+                out += c;
+            }
+        }
+    }
+    out += '"';
+}
+
+static std::string_view hypothesisText(const seshat::hypothesis& hyp)
+{
+#ifdef SESHAT_HYPOTHESIS_TREE
+    return {}; // only the tree is available
+#else
+    return hyp.repr;
+#endif
+}
+
+// LaTeX compared without whitespace
+static std::string normalizeLaTeX(std::string_view str)
+{
+    std::string out;
+    for (const char c : str)
+        if (c != ' ' && c != '\t' && c != '\r' && c != '\n')
+            out += c;
+    return out;
+}
@@ -0,0 +1,260 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <math_input.hpp>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+// Every .scgink file under a directory, a single file or corpus, or the files named in a list file
+static void collectInputs(const fs::path& arg, std::vector<fs::path>& files, std::vector<fs::path>& corpora)
+{
+    std::error_code ec;
+    if (fs::is_directory(arg, ec)) {
+        std::vector<fs::path> found;
+        for (const auto& entry : fs::recursive_directory_iterator(arg, ec))
+            if (entry.is_regular_file() && entry.path().extension() == ".scgink")
+                found.push_back(entry.path());
+        std::sort(found.begin(), found.end());
+        files.insert(files.end(), found.begin(), found.end());
+    } else if (arg.extension() == ".scgink") {
+        files.push_back(arg);
+    } else if (arg.extension() == ".inkc") {
+        corpora.push_back(arg);
+    } else {
+        std::ifstream list(arg);
+        if (!list) {
+            std::cerr << "Error opening list file '" << arg.string() << "'\n";
+            return;
+        }
+        // Relative paths are relative to the list file
+        std::string line;
+        while (std::getline(list, line)) {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (line.empty())
+                continue;
+            const fs::path p(line);
+            files.push_back(p.is_relative() ? arg.parent_path() / p : p);
+        }
+    }
+}
+
+// Ground truth: one "<name><TAB><LaTeX>" per line, name being the file name without extension
+static std::unordered_map<std::string, std::string> loadTruth(const char* path)
+{
+    std::unordered_map<std::string, std::string> truth;
+    std::ifstream fd(path);
+    if (!fd) {
+        std::cerr << "Error opening ground truth file '" << path << "'\n";
+        return truth;
+    }
+    std::string line;
+    while (std::getline(fd, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        const auto tab = line.find('\t');
+        if (tab == std::string::npos)
+            continue;
+        truth[fs::path(line.substr(0, tab)).stem().string()] = line.substr(tab + 1);
+    }
+    return truth;
+}
+
+int main(int argc, char* argv[])
+{
+    // Because some of the feature extraction code uses std::cout/std::cin
+    std::ios_base::sync_with_stdio(true);
+
+    unsigned threads = 0;
+    std::size_t chunk = 1024;
+    const char* truth_path = nullptr;
+    const char* pack_path = nullptr;
+    bool pages = false;
+    auto pack_encoding = seshat::corpus::encoding::float32;
+    std::vector<fs::path> files, corpora;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = std::atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--chunk") && i + 1 < argc) {
+            chunk = std::max(1, std::atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--truth") && i + 1 < argc) {
+            truth_path = argv[++i];
+        } else if (!strcmp(argv[i], "--pack") && i + 1 < argc) {
+            pack_path = argv[++i];
+        } else if (!strcmp(argv[i], "--pages")) {
+            pages = true;
+        } else if (!strcmp(argv[i], "--int16")) {
+            pack_encoding = seshat::corpus::encoding::int16;
+        } else {
+            collectInputs(argv[i], files, corpora);
+        }
+    }
+
+    if (files.empty() && corpora.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--threads <n>] [--chunk <files>] [--truth <file>] [--pack <out.inkc> [--int16]] [--pages] <directory | .scgink file | .inkc corpus | list file>..." << std::endl;
+        std::cerr << "Writes one JSON object per expression to stdout. The ground truth file has one '<name><TAB><LaTeX>' line per expression" << std::endl;
+        std::cerr << "With --pages, each .scgink file is a page holding several expressions, reported one region per line" << std::endl;
+        std::cerr << "With --pack, the .scgink files (and their ground truth) are converted to a single corpus file instead" << std::endl;
+        std::cerr << "Note: run in a directory with a file available at ./Config/CONFIG" << std::endl;
+        return 1;
+    }
+
+    const auto truth = truth_path ? loadTruth(truth_path) : std::unordered_map<std::string, std::string>{};
+    const auto truthOf = [&truth](const fs::path& file) -> const std::string* {
+        const auto it = truth.find(file.stem().string());
+        return it != truth.end() ? &it->second : nullptr;
+    };
+
+    // Convert to a corpus file
+    if (pack_path) {
+        seshat::corpus_writer writer;
+        std::size_t nskipped = 0;
+        for (const auto& file : files) {
+            // Files that could not be loaded (already reported) are left out
+            const auto sample = loadSCGInk(file.string().c_str());
+            if (sample.strokes.empty()) {
+                ++nskipped;
+                continue;
+            }
+            const auto label = truthOf(file);
+            writer.add(sample, label ? *label : std::string_view{});
+        }
+        try {
+            writer.write(pack_path, pack_encoding);
+        } catch (const std::exception&) {
+            return 1;
+        }
+        std::fprintf(stderr, "Packed %zd expressions into '%s'\n", writer.size(), pack_path);
+        if (nskipped)
+            std::fprintf(stderr, "Skipped %zd files without strokes\n", nskipped);
+        return nskipped ? 1 : 0;
+    }
+
+    // Load system configuration
+    seshat::math_expression recog;
+
+    std::size_t nparsed = 0, nlabeled = 0, ncorrect = 0;
+    bool failed = false;
+    std::string line;
+    const auto start = std::chrono::steady_clock::now();
+
+    const auto report = [&](std::string_view name, std::size_t nstrokes, std::chrono::nanoseconds time, const std::vector<seshat::hypothesis>& hyps, const std::string* label) {
+        if (nstrokes)
+            ++nparsed;
+
+        line.clear();
+        line += "{\"file\":";
+        writeJSON(line, name);
+        line += ",\"strokes\":" + std::to_string(nstrokes);
+        char ms[32];
+        std::snprintf(ms, sizeof(ms), "%.3f", std::chrono::duration<double, std::milli>(time).count());
+        line += ",\"ms\":";
+        line += ms;
+        line += ",\"hypotheses\":[";
+        for (std::size_t k = 0; k < hyps.size(); ++k) {
+            if (k)
+                line += ',';
+            writeJSON(line, hypothesisText(hyps[k]));
+        }
+        line += ']';
+
+        if (label) {
+            ++nlabeled;
+            const bool correct = !hyps.empty() && normalizeLaTeX(hypothesisText(hyps[0])) == normalizeLaTeX(*label);
+            ncorrect += correct;
+            line += ",\"truth\":";
+            writeJSON(line, *label);
+            line += correct ? ",\"correct\":true" : ",\"correct\":false";
+        }
+        line += "}\n";
+        std::fwrite(line.data(), 1, line.size(), stdout);
+    };
+
+    // Split every page into expressions, parsed in parallel
+    for (std::size_t i = 0; pages && i < files.size(); ++i) {
+        const auto regions = recog.parse_page(loadSCGInk(files[i].string().c_str()), threads);
+
+        for (std::size_t r = 0; r < regions.size(); ++r) {
+            const auto& reg = regions[r];
+            ++nparsed;
+
+            line.clear();
+            line += "{\"file\":";
+            writeJSON(line, files[i].string());
+            line += ",\"region\":" + std::to_string(r);
+            line += ",\"box\":[" + std::to_string(reg.x) + ',' + std::to_string(reg.y) + ',' + std::to_string(reg.s) + ',' + std::to_string(reg.t) + ']';
+            line += ",\"strokes\":" + std::to_string(reg.strokes.size());
+            line += ",\"hypotheses\":[";
+            for (std::size_t k = 0; k < reg.hypotheses.size(); ++k) {
+                if (k)
+                    line += ',';
+                writeJSON(line, hypothesisText(reg.hypotheses[k]));
+            }
+            line += "]}\n";
+            std::fwrite(line.data(), 1, line.size(), stdout);
+        }
+        std::fflush(stdout);
+    }
+
+    // Read and parse a chunk of files at a time, keeping the parsers of every thread
+    for (std::size_t first = 0; !pages && first < files.size(); first += chunk) {
+        const std::size_t last = std::min(files.size(), first + chunk);
+
+        std::vector<seshat::sample> inputs(last - first);
+        for (std::size_t i = first; i < last; ++i)
+            inputs[i - first] = loadSCGInk(files[i].string().c_str());
+
+        std::vector<std::chrono::nanoseconds> times(inputs.size());
+        const auto results = recog.parse_batch(inputs, threads, times);
+
+        for (std::size_t i = 0; i < inputs.size(); ++i)
+            report(files[first + i].string(), inputs[i].strokes.size(), times[i], results[i], truthOf(files[first + i]));
+        std::fflush(stdout);
+    }
+
+    // Corpus samples are parsed straight from the file, named <corpus>#<index>
+    for (const auto& path : corpora) {
+        try {
+            const seshat::corpus pack(path.string().c_str());
+            const auto views = pack.views();
+
+            for (std::size_t first = 0; first < views.size(); first += chunk) {
+                const auto inputs = std::span(views).subspan(first, std::min(chunk, views.size() - first));
+
+                std::vector<std::chrono::nanoseconds> times(inputs.size());
+                const auto results = recog.parse_batch(inputs, threads, times);
+
+                for (std::size_t i = 0; i < inputs.size(); ++i) {
+                    const std::string label(pack.label(first + i));
+                    report(path.string() + "#" + std::to_string(first + i), inputs[i].size(), times[i], results[i], label.empty() ? nullptr : &label);
+                }
+                std::fflush(stdout);
+            }
+        } catch (const std::exception&) {
+            // The error was already reported
+            std::cerr << "Skipping corpus '" << path.string() << "'\n";
+            failed = true;
+        }
+    }
+
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::fprintf(stderr, "Expressions parsed:    %zd in %.2f s (%.2f/s)\n", nparsed, secs, nparsed / secs);
+    if (nlabeled)
+        std::fprintf(stderr, "Expression rate:       %zd/%zd (%.2f%%)\n", ncorrect, nlabeled, 100.0 * ncorrect / nlabeled);
+    return failed ? 1 : 0;
+}
@@ -15,12 +15,15 @@
     You should have received a copy of the GNU General Public License
     along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <cfloat>
 #include <chrono>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
 #include <seshat/seshat.hpp>
+#include <vector>
 
 static seshat::sample loadSCGInk(const char* path)
 {
@@ -55,26 +58,141 @@ static seshat::sample loadSCGInk(const char* path)
     return out;
 }
 
+static void printReport(const seshat::statistics& st, std::size_t nfiles, std::chrono::steady_clock::duration total)
+{
+    using ms = std::chrono::duration<double, std::milli>;
+    const auto per_cls = [&st](std::chrono::nanoseconds t, std::size_t n) {
+        return n ? ms(t).count() / n : 0.0;
+    };
+    const std::size_t offline_runs = st.classifications - st.offline_skipped + st.cascade_audited;
+
+    printf("Files parsed:          %zd (%.2f ms/file)\n", nfiles, ms(total).count() / nfiles);
+    printf("Symbol classifications: %zd\n", st.classifications);
+    printf("Offline skipped:       %zd (%.1f%%)\n", st.offline_skipped, st.classifications ? 100.0 * st.offline_skipped / st.classifications : 0.0);
+    printf("Online classifier:     %.3f ms/call\n", per_cls(st.online_time, st.classifications));
+    printf("Offline classifier:    %.3f ms/call\n", per_cls(st.offline_time, offline_runs));
+    const std::size_t avoided = st.segments_implausible + st.segments_low_prob + st.segments_bounded;
+    printf("Segmentations:         %zd (%zd not classified: %zd implausible, %zd low probability, %zd bounded)\n", st.segments, avoided, st.segments_implausible, st.segments_low_prob, st.segments_bounded);
+    printf("Fusions bounded:       %zd\n", st.fusions_bounded);
+    printf("Fusions dead:          %zd\n", st.fusions_dead);
+    printf("Relations scored:      %zd\n", st.relations_scored);
+    printf("Terminals dead:        %zd\n", st.terminals_dead);
+    if (st.agenda_popped || st.agenda_fallbacks)
+        printf("Best-first:            %zd hypotheses popped, %zd fallbacks to CYK\n", st.agenda_popped, st.agenda_fallbacks);
+    if (st.partial_parses)
+        printf("Partial parses:        %zd (deadline reached)\n", st.partial_parses);
+    if (st.parses_reduced || st.parses_minimal)
+        printf("Lower effort parses:   %zd reduced, %zd minimal\n", st.parses_reduced, st.parses_minimal);
+    if (st.cascade_audited)
+        printf("Cascade agreement:     %zd/%zd (%.1f%%)\n", st.cascade_agreed, st.cascade_audited, 100.0 * st.cascade_agreed / st.cascade_audited);
+}
+
 int main(int argc, char* argv[])
 {
     // Because some of the feature extraction code uses std::cout/std::cin
     std::ios_base::sync_with_stdio(true);
 
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <path to .scgink file>" << std::endl;
+    float cascade_top = 0, cascade_margin = 0;
+    float seg_prob = 0, seg_score = -FLT_MAX;
+    bool audit = false, report = false, best_first = false;
+    double deadline_ms = 0, latency_ms = 0;
+    int threads = -1;
+    std::vector<const char*> files;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--cascade") && i + 2 < argc) {
+            cascade_top = std::atof(argv[++i]);
+            cascade_margin = std::atof(argv[++i]);
+            report = true;
+        } else if (!strcmp(argv[i], "--segment-pruning") && i + 2 < argc) {
+            seg_prob = std::atof(argv[++i]);
+            seg_score = std::atof(argv[++i]);
+            report = true;
+        } else if (!strcmp(argv[i], "--best-first")) {
+            best_first = true;
+            report = true;
+        } else if (!strcmp(argv[i], "--deadline") && i + 1 < argc) {
+            deadline_ms = std::atof(argv[++i]);
+            report = true;
+        } else if (!strcmp(argv[i], "--latency") && i + 1 < argc) {
+            latency_ms = std::atof(argv[++i]);
+            report = true;
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = std::atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--audit")) {
+            audit = true;
+            report = true;
+        } else if (!strcmp(argv[i], "--stats")) {
+            report = true;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+
+    if (files.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--cascade <top> <margin>] [--audit] [--segment-pruning <prob> <score>] [--best-first] [--deadline <ms>] [--latency <ms>] [--threads <n>] [--stats] <path to .scgink file>..." << std::endl;
         std::cerr << "Note: run in a directory with a file available at ./Config/CONFIG" << std::endl;
+        return 1;
     }
 
-    // Load sample and system configuration
-    seshat::sample s = loadSCGInk(argv[1]);
+    const std::size_t nfiles = files.size();
+
+    // Load system configuration
     seshat::math_expression recog;
-    auto hyps = recog.parse_sample(s);
-    printf("Found %zd hypothesis\n", hyps.size());
-    for (const auto& hyp : hyps) {
+    recog.want_classifier_cascade(cascade_top, cascade_margin, audit);
+    recog.want_segment_pruning(seg_prob, seg_score);
+    recog.want_best_first(best_first);
+    recog.want_latency_target(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double, std::milli>(latency_ms)));
+
+    const auto printHypotheses = [](const std::vector<seshat::hypothesis>& hyps, bool partial, seshat::parse_effort effort) {
+        static const char* const efforts[] = { "", " (reduced effort)", " (minimal effort)" };
+        printf("Found %zd hypothesis%s%s\n", hyps.size(), partial ? " (partial)" : "", efforts[static_cast<int>(effort)]);
+        for (const auto& hyp : hyps) {
 #ifdef SESHAT_HYPOTHESIS_TREE
 
 #else
-        printf("%s\n", hyp.repr.c_str());
+            printf("%s\n", hyp.repr.c_str());
 #endif
+        }
+    };
+
+    std::chrono::steady_clock::duration total{};
+
+    // Parse every file at once over several threads
+    if (threads >= 0) {
+        std::vector<seshat::sample> inputs;
+        for (const auto path : files) {
+            inputs.push_back(loadSCGInk(path));
+            if (inputs.back().strokes.empty())
+                inputs.pop_back();
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        const auto results = recog.parse_batch(inputs, threads);
+        total += std::chrono::steady_clock::now() - start;
+
+        for (const auto& hyps : results)
+            printHypotheses(hyps, false, seshat::parse_effort::full);
+        files.clear();
     }
+
+    for (const auto path : files) {
+        // Load sample
+        seshat::sample s = loadSCGInk(path);
+        if (s.strokes.empty())
+            continue;
+
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<seshat::hypothesis> hyps;
+        auto status = seshat::parse_status::complete;
+        if (deadline_ms > 0)
+            status = recog.parse_sample(s, hyps, start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(deadline_ms)));
+        else
+            recog.parse_sample(s, hyps);
+        total += std::chrono::steady_clock::now() - start;
+
+        printHypotheses(hyps, status == seshat::parse_status::partial, recog.last_effort());
+    }
+
+    if (report)
+        printReport(recog.get_statistics(), nfiles, total);
 }
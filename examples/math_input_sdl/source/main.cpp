@@ -21,6 +21,7 @@
 #include <cstring>
 #include <iostream>
 #include <ranges>
+#include <seshat/recognizer.hpp>
 #include <seshat/seshat.hpp>
 
 struct WindowDeleter {
@@ -259,6 +260,8 @@ static void workSDL()
     bool handled_last_draw = true;
     seshat::sample s;
     seshat::math_expression recog;
+    // parses on a worker thread so drawing never waits for it
+    seshat::async_recognizer worker(recog);
 
     auto surf = SDL_CreateRGBSurface(0, squareRect.w, squareRect.h, 32,
                                      0x00FF0000,
@@ -353,9 +356,18 @@ static void workSDL()
             handled_last_draw = true;
 
             printf("Parsing %zd strokes with %zd total points\n", s.strokes.size(), s.total_points);
-            auto hyps = recog.parse_sample(s);
-            printf("Found %zd hypothesis\n", hyps.size());
-            for (const auto& hyp : hyps) {
+            worker.submit(s);
+        }
+        if (auto res = worker.take()) {
+            if (res->error) {
+                try {
+                    std::rethrow_exception(res->error);
+                } catch (const std::exception& ex) {
+                    printf("Parsing failed: %s\n", ex.what());
+                }
+            }
+            printf("Found %zd hypothesis\n", res->hypotheses.size());
+            for (const auto& hyp : res->hypotheses) {
 #ifdef SESHAT_HYPOTHESIS_TREE
                 if (hyp.tokens.empty())
                     continue;
@@ -86,7 +86,7 @@ struct FullConnection : public Connection {
     }
     static const std::string& make_name(Layer* f, Layer* t, const std::vector<int>& d)
     {
-        static std::string name;
+        thread_local std::string name;
         name = f->name + "_to_" + t->name;
         if (find_if(d.begin(), d.end(), std::bind(std::not_equal_to<int>(), std::placeholders::_1, 0)) != d.end()) {
             std::ostringstream temp;
@@ -0,0 +1,87 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef _AGENDA_
+#define _AGENDA_
+
+#include "cellcyk.hpp"
+#include "internal_hypothesis.hpp"
+#include <deque>
+#include <memory>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace seshat {
+
+// State of a best-first (A*) parse. There is one cell per set of strokes, popped hypotheses
+// are kept at stable addresses, and pending ones are ordered by their inside log-probability
+// plus an admissible estimate of the best score the strokes left out can add
+class Agenda {
+    struct Cell;
+
+    struct Item {
+        double f;
+        long seq;
+        Cell* cell;
+        InternalHypothesis H;
+
+        bool operator<(const Item& I) const
+        {
+            return f < I.f || (f == I.f && seq > I.seq);
+        }
+    };
+
+    struct Cell {
+        std::unique_ptr<CellCYK> cell;
+        double outside;
+        std::vector<std::pair<int, const InternalHypothesis*>> closed;
+    };
+
+    int nstrokes, nnt;
+    std::vector<double> strokeBound; // best score per stroke of a terminal covering it
+    double totalBound;
+    std::unordered_map<std::vector<bool>, Cell> cells;
+    std::priority_queue<Item> queue;
+    std::deque<InternalHypothesis> closed;
+    long seq{ 0 };
+
+    Cell& lookup(const CellCYK* c);
+    static bool isClosed(const Cell& cell, int nt);
+
+public:
+    // Hypotheses popped so far, by non-terminal
+    std::vector<std::vector<InternalHypothesis*>> byNoTerm;
+
+    Agenda(int n, int k);
+
+    // Bound the outside score with the terminal hypotheses of cell c, before any push
+    void bound(const CellCYK* c);
+    // Done bounding. Returns false if some stroke isn't covered by any terminal
+    bool seal();
+
+    // Offer hypothesis H of the strokes of c, kept if it improves the pending one
+    void push(const CellCYK* c, const InternalHypothesis& H);
+    // Next most promising hypothesis (nullptr when the agenda is empty)
+    InternalHypothesis* pop();
+    bool coversAll(const InternalHypothesis* H) const;
+};
+
+}
+
+#endif
@@ -19,20 +19,55 @@
 #define _CELLCYK_
 
 #include "internal_hypothesis.hpp"
+#include <cstdint>
 #include <cstdio>
 #include <memory>
 #include <vector>
 
 namespace seshat {
 
+// Hypotheses of a cell for the (few) non-terminals it actually holds, stored inline and
+// sorted by non-terminal id, plus a presence mask of the first MASK_BITS ids. Pointers
+// into the set are only stable once its cell stops growing (i.e. its size is complete)
+class NoTermSet {
+public:
+    struct Entry {
+        int nt;
+        InternalHypothesis H;
+    };
+
+private:
+    static constexpr int MASK_BITS = 128;
+    std::uint64_t mask[MASK_BITS / 64]{};
+    std::vector<Entry> entries;
+
+    std::vector<Entry>::iterator find(int nt);
+    std::vector<Entry>::const_iterator find(int nt) const;
+    bool masked(int nt) const;
+
+public:
+    // Hypothesis for non-terminal nt, or nullptr
+    InternalHypothesis* operator[](int nt);
+    const InternalHypothesis* operator[](int nt) const;
+    // Store (or replace) the hypothesis for non-terminal nt
+    InternalHypothesis* set(int nt, const InternalHypothesis& H);
+    void erase(int nt);
+    // Move out every entry, leaving the set empty
+    std::vector<Entry> take();
+
+    bool empty() const;
+    std::vector<Entry>::const_iterator begin() const;
+    std::vector<Entry>::const_iterator end() const;
+};
+
 struct CellCYK {
     // Bounding box spatial region coordinates
     int x, y; // top-left
     int s, t; // bottom-right
 
-    // Hypotheses for every non-terminals
+    // Hypotheses for the non-terminals (nnt in the grammar)
     int nnt;
-    std::vector<std::unique_ptr<InternalHypothesis>> noterm;
+    NoTermSet noterm;
 
     // Strokes covered in this cell
     int nc;
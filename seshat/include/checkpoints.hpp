@@ -0,0 +1,77 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef _CHECKPOINTS_
+#define _CHECKPOINTS_
+
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <seshat/hypothesis.hpp>
+#include <span>
+#include <variant>
+#include <vector>
+
+namespace seshat {
+
+// Results kept between parses of strokes that are only added or removed at the end, so
+// that parsing again after an undo (or after adding a stroke) doesn't redo what is known.
+// Entries are dropped oldest first once their estimated size exceeds the limit
+class Checkpoints {
+public:
+    // Classifier output for a set of strokes
+    struct Classification {
+        std::vector<int> clase;
+        std::vector<float> pr;
+        int cmy, asc, des;
+    };
+
+private:
+    std::map<std::vector<int>, Classification> classes;
+    std::map<int, std::vector<hypothesis>> results; // N-best output per number of strokes
+
+    // Insertion order for eviction: the strokes of a classification or the number of strokes of a result
+    using Entry = std::variant<std::vector<int>, int>;
+    std::deque<Entry> order;
+    std::size_t bytes{ 0 };
+    std::size_t limit;
+
+    static std::size_t size(const std::vector<int>& key, const Classification& C);
+    static std::size_t size(const std::vector<hypothesis>& hyps);
+    void evict();
+
+public:
+    explicit Checkpoints(std::size_t max_bytes);
+
+    void setLimit(std::size_t max_bytes);
+    std::size_t memory() const;
+
+    // Strokes ids must be sorted
+    const Classification* find(std::span<const int> stks) const;
+    void store(std::span<const int> stks, Classification C);
+
+    const std::vector<hypothesis>* result(int nstrokes) const;
+    void store(int nstrokes, const std::vector<hypothesis>& hyps);
+
+    // Forget everything involving strokes from `nstrokes` on
+    void truncate(int nstrokes);
+    void clear();
+};
+
+}
+
+#endif
@@ -23,6 +23,7 @@
 #include <cstdio>
 #include <map>
 #include <memory>
+#include <span>
 #include <string>
 #include <unordered_set>
 #include <vector>
@@ -44,6 +45,14 @@ struct Grammar {
     Grammar(const fs::path& conf, SymRec* SR);
 
     const char* key2str(int k);
+    // Non-terminals that can take part in a derivation of a start symbol
+    // when only the symbol classes marked in `clases` can be recognized
+    std::vector<bool> liveNoTerminals(const std::vector<bool>& clases);
+    // Fewest strokes that the rest of an expression needs besides a hypothesis of each
+    // non-terminal, using only the given productions (INT_MAX when it can't be part of one)
+    std::vector<int> minStrokesLeft(std::span<ProductionB* const> prods, std::span<ProductionT* const> terms);
+    // Whether the symbol composed by a binary production (if any) is in `clases`
+    bool composesClase(ProductionB& pd, const std::vector<bool>& clases);
     void addInitSym(const std::string& str);
     void addNoTerminal(const std::string& str);
     void addTerminal(float pr, const std::string& S, const std::string& T, const std::string& tex);
@@ -25,30 +25,50 @@ class ProductionT;
 
 struct CellCYK;
 
-struct InternalHypothesis {
-    int clase; // If the hypothesis encodes a terminal symbols this is the class id (-1 otherwise)
-    double pr; // log-probability
+struct InternalHypothesis;
 
+// How a hypothesis was derived. Only read when rebuilding the derivation tree and in the
+// SSE pass, so it is kept apart from the fields the CYK inner loops touch
+struct Derivation {
     // References to left-child (hi) and right-child (hd) to create the derivation tree
-    InternalHypothesis *hi, *hd;
+    const InternalHypothesis *hi{ nullptr }, *hd{ nullptr };
 
     // The production used to create this hypothesis (either Binary or terminal)
-    ProductionB* prod;
-    ProductionT* pt;
+    ProductionB* prod{ nullptr };
+    ProductionT* pt{ nullptr };
 
     // Auxiliar var to retrieve the used production in the special SSE treatment
-    ProductionB* prod_sse;
+    ProductionB* prod_sse{ nullptr };
+
+    double pr{ 0 }; // log-probability of the hypothesis this derivation created
+    int clase{ -1 }; // class id of a terminal symbol (-1 otherwise)
+
+    // Next alternative derivation of the same cell and non-terminal, kept for k-best extraction
+    Derivation* alt{ nullptr };
+
+    // Insert the chain of alternatives starting at d after this derivation
+    void splice(Derivation* d);
+};
+
+struct InternalHypothesis {
+    double pr; // log-probability
+    int clase; // If the hypothesis encodes a terminal symbols this is the class id (-1 otherwise)
 
     // Vertical center left and right
     int lcen, rcen;
 
-    CellCYK* parent; // Parent cell
+    // Horizontal extent of the leftmost (lx, ls) and rightmost (rx, rs) terminal symbols
+    int lx, ls, rx, rs;
+
     int ntid; // Nonterminal ID in parent
+    CellCYK* parent; // Parent cell
+    Derivation* der; // Derivation record, owned by the parser
 
     // Methods
-    InternalHypothesis(int c, double p, CellCYK* cd, int nt);
+    InternalHypothesis(int c, double p, CellCYK* cd, int nt, Derivation* d = nullptr);
 
     void copy(const InternalHypothesis& SYM);
+    void setTermExtent(const InternalHypothesis& A, const InternalHypothesis& B);
 };
 
 }
@@ -0,0 +1,67 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef _KBEST_
+#define _KBEST_
+
+#include "internal_hypothesis.hpp"
+#include <deque>
+#include <set>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace seshat {
+
+// Lazy extraction of the k most likely derivations out of the alternatives kept in the
+// CYK table (Huang & Chiang, "Better k-best parsing", 2005). The derivations of a node
+// (cell and non-terminal) are only enumerated as far as they are asked for
+class KBest {
+    // Derivation e using the i-th best left child and the j-th best right child
+    struct Candidate {
+        double pr;
+        Derivation* e;
+        int i, j;
+
+        bool operator<(const Candidate& C) const
+        {
+            return pr < C.pr;
+        }
+    };
+
+    struct Node {
+        std::vector<const InternalHypothesis*> best; // derivations found so far, most likely first
+        std::vector<Candidate> heap;
+        std::set<std::tuple<const Derivation*, int, int>> seen;
+    };
+
+    std::unordered_map<const InternalHypothesis*, Node> nodes;
+    std::deque<InternalHypothesis> hyps;
+    std::deque<Derivation> ders;
+
+    void push(Node& node, Derivation* e, int i, int j);
+
+public:
+    // k-th most likely derivation of the node of H (H itself for k = 0), or nullptr
+    const InternalHypothesis* get(const InternalHypothesis* H, int k);
+    // The k most likely derivations of the roots, preferring those that cover more strokes
+    std::vector<const InternalHypothesis*> best(const std::vector<const InternalHypothesis*>& roots, int k);
+};
+
+}
+
+#endif
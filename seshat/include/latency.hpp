@@ -0,0 +1,50 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef _LATENCY_
+#define _LATENCY_
+
+#include <array>
+#include <chrono>
+#include <seshat/effort.hpp>
+
+namespace seshat {
+
+// Picks the effort of each parse from an estimate of its work, so that it takes about the
+// latency target. The time per unit of work of each level is learnt from the parses run
+class LatencyControl {
+    // Time per unit of work of a level, in ns, 0 until a parse is measured
+    struct Rate {
+        double mean{ 0 }, dev{ 0 }; // Moving average and mean deviation
+        int skipped{ 0 }; // Parses since the level was last chosen
+    };
+
+    std::chrono::nanoseconds target{ 0 };
+    std::array<Rate, 3> rates{};
+
+public:
+    void setTarget(std::chrono::nanoseconds t);
+    bool enabled() const;
+
+    // Most thorough level expected to finish in time, given the work each level would do
+    parse_effort choose(const std::array<double, 3>& work);
+    void measure(parse_effort e, double work, std::chrono::nanoseconds elapsed);
+};
+
+}
+
+#endif
@@ -19,16 +19,33 @@
 #define _LOGSPACE_
 
 #include "cellcyk.hpp"
+#include <array>
 #include <cstdio>
 #include <list>
+#include <seshat/windows.hpp>
+#include <vector>
 
 namespace seshat {
 
 class LogSpace {
     int N;
     int RX, RY;
+    search_windows win;
     std::unique_ptr<CellCYK*[]> data;
 
+    // Search window (sx,sy)-(ss,st) of each spatial relation
+    struct Window {
+        int sx, sy, ss, st;
+    };
+    Window windowH(const CellCYK* c) const;
+    Window windowV(const CellCYK* c) const;
+    Window windowU(const CellCYK* c) const;
+    Window windowI(const CellCYK* c) const;
+    Window windowM(const CellCYK* c) const;
+    Window windowS(const CellCYK* c) const;
+    int rx(float f) const;
+    int ry(float f) const;
+
     void quicksort(CellCYK** vec, int ini, int fin);
     int partition(CellCYK** vec, int ini, int fin);
     void bsearch(int sx, int sy, int ss, int st, std::vector<CellCYK*>& set);
@@ -36,7 +53,7 @@ class LogSpace {
     void bsearchHBP(int sx, int sy, int ss, int st, std::vector<CellCYK*>& set, CellCYK* cd);
 
 public:
-    LogSpace(CellCYK* c, int nr, int dx, int dy);
+    LogSpace(CellCYK* c, int nr, int dx, int dy, const search_windows& w);
 
     void getH(CellCYK* c, std::vector<CellCYK*>& set);
     void getV(CellCYK* c, std::vector<CellCYK*>& set);
@@ -44,6 +61,24 @@ public:
     void getI(CellCYK* c, std::vector<CellCYK*>& set);
     void getM(CellCYK* c, std::vector<CellCYK*>& set);
     void getS(CellCYK* c, std::vector<CellCYK*>& set);
+
+    bool inH(const CellCYK* c, const CellCYK* d) const;
+    bool inV(const CellCYK* c, const CellCYK* d) const;
+    bool inU(const CellCYK* c, const CellCYK* d) const;
+    bool inI(const CellCYK* c, const CellCYK* d) const;
+    bool inM(const CellCYK* c, const CellCYK* d) const;
+};
+
+// What the search windows have to span to hold the relations found by some parses, in order
+// to derive them from a calibration corpus
+class WindowCalibration {
+    std::array<std::vector<float>, 11> needs; // One per search_windows field
+
+public:
+    // Relation of a production of type `tipo` between the regions a and b
+    void add(char tipo, const CellCYK* a, const CellCYK* b, int RX, int RY);
+    // Windows spanning the given quantile of the relations seen (or as in `w` if none was)
+    search_windows windows(search_windows w, float quantile) const;
 };
 
 }
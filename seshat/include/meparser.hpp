@@ -18,8 +18,12 @@
 #ifndef _MEPARSER_
 #define _MEPARSER_
 
+#include "agenda.hpp"
+#include "checkpoints.hpp"
 #include "duration.hpp"
 #include "grammar.hpp"
+#include "latency.hpp"
+#include "logspace.hpp"
 #include "path.hpp"
 #include "production.hpp"
 #include "samples.hpp"
@@ -27,42 +31,105 @@
 #include "sparel.hpp"
 #include "symrec.hpp"
 #include "tablecyk.hpp"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <memory>
 #include <optional>
+#include <seshat/effort.hpp>
+#include <seshat/executor.hpp>
+#include <seshat/forest.hpp>
 #include <seshat/hypothesis.hpp>
+#include <seshat/statistics.hpp>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 namespace seshat {
 
+// When a parse has to give up: on a stop request or past a deadline
+struct ParseLimit {
+    std::stop_token stop;
+    std::chrono::steady_clock::time_point deadline{ std::chrono::steady_clock::time_point::max() };
+
+    bool reached() const
+    {
+        return stop.stop_requested() || (deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() >= deadline);
+    }
+};
+
 class meParser {
     std::unique_ptr<Grammar> G;
 
     int max_strokes;
     float clusterF, segmentsTH;
+    float segMaxSize; // Largest multi-stroke symbol, in reference symbol sizes (0 = no limit)
+    float segMinProb, segMinScore; // Lower bounds to classify a multi-stroke segmentation
     float ptfactor, pbfactor, rfactor;
     float qfactor, dfactor, gfactor, InsPen;
+    bool bestFirst; // search the 1-best hypothesis best-first before filling the chart
+    std::size_t bestFirstItems; // hypotheses the best-first search may pop (0 = no limit)
+
+    statistics stats;
+
+    // Effort of the current parse, and the settings it implies
+    LatencyControl latency;
+    parse_effort effort;
+    int nbest; // classes of each segmentation added to the table
+    int segStrokes; // most strokes in a symbol
+    float segProb; // least segmentation probability to classify
+    double chooseEffort(int N);
 
     std::unique_ptr<SymRec> sym_rec;
     std::unique_ptr<GMM> gmm_spr;
     std::optional<DurationModel> duration;
     std::optional<SegmentationModelGMM> segmentation;
+    // Productions that can still be used with the allowed symbol classes
+    std::vector<ProductionB*> actH, actSup, actSub, actV, actVe, actIns, actMrt, actSSE;
+    std::vector<ProductionT*> actTerms;
+    std::vector<float> maxTermScore; // best prior and duration score of a terminal, per size
+    // Fewest strokes the rest of an expression needs besides each non-terminal: hypotheses
+    // that leave fewer can't take part in a parse of every stroke and are not created
+    std::vector<int> minLeft;
+    // Whether a hypothesis of non-terminal nt covering `size` strokes can't be in such a parse.
+    // minLeft is INT_MAX for unreachable non-terminals, so it isn't added to
+    bool dead(int nt, int size, int N) const
+    {
+        return minLeft[nt] > N - size;
+    }
+    search_windows windows; // where the second member of each spatial relation is searched
+    WindowCalibration* calibration{ nullptr }; // if set, collects the relations of every parse
+    void calibrate(const InternalHypothesis* H, const Samples& M);
+
     std::vector<CellCYK*> c1setH, c1setV, c1setU, c1setI, c1setM, c1setS;
-    std::vector<int> close_list;
+    std::vector<std::vector<int>> close_strokes;
     std::vector<int> stks_list;
     std::vector<int> stkvec;
+    std::deque<Derivation> derivations; // derivation records of the current parse
     unsigned maxHypothesis;
 
     // Private methods
     void loadSymRec(const fs::path& conf);
+    void restrictGrammar(const std::vector<bool>& clases);
 
+    Derivation* derive(const Derivation& d);
     void initCYKterms(Samples& m, TableCYK& tcyk, int N, int K);
 
+    void proximityGraph(Samples& M, int N);
     void combineStrokes(Samples& M, TableCYK& tcyk, int N);
+    void extendSegment(Samples& M, TableCYK& tcyk, int N, int anchor, std::vector<int> extension);
+    bool testSegment(Samples& M, TableCYK& tcyk, int N);
     CellCYK* fusion(Samples& M, ProductionB* pd, InternalHypothesis* A, InternalHypothesis* B, int N, double prob);
+    const InternalHypothesis* parseBestFirst(Samples& M, TableCYK& tcyk, Agenda& agenda);
+    bool rejected(TableCYK& tcyk, int n, ProductionB* pd, InternalHypothesis* A, InternalHypothesis* B, double relprob);
 
 #ifdef SESHAT_HYPOTHESIS_TREE
     // fill with tree representation of the input
-    int makeTree(hypothesis& into, const InternalHypothesis* H, int id);
+    std::size_t makeTree(hypothesis& into, const InternalHypothesis* H);
 #else
     // fill with LaTeX string
     void makeLatex(hypothesis& into, const InternalHypothesis* H);
@@ -70,13 +137,48 @@ class meParser {
 
     void fillHypothesis(hypothesis& into, const InternalHypothesis* H);
 
+    // Forest nodes and interned strings of the current parse
+    std::unordered_map<const InternalHypothesis*, std::uint32_t> forestNodes;
+    std::unordered_map<std::string_view, std::uint32_t> forestStrings;
+    std::uint32_t makeForest(forest& into, const InternalHypothesis* H);
+    std::uint32_t intern(forest& into, std::string_view str);
+
+    // Limit of the current parse, and whether it was reached
+    ParseLimit limit;
+    bool partial;
+    bool stopped();
+
+    // Classifier results kept between parses of the same strokes, if any
+    Checkpoints* cache{ nullptr };
+    int classify(Samples& M, std::span<const int> stks, int* clase, float* pr, int& asc, int& des);
+
+    // Run the parser, handing the most likely hypotheses to emit. Returns false if the limit
+    // was reached before the parse completed
+    bool parse(Samples& M, const ParseLimit& lim, Checkpoints* cp, const std::function<void(std::span<const InternalHypothesis* const>)>& emit);
+
 public:
     meParser(const fs::path& conf);
 
     // Parse math expression
-    void parse_me(Samples& M, std::vector<hypothesis>& output);
+    bool parse_me(Samples& M, std::vector<hypothesis>& output, const ParseLimit& lim = {}, Checkpoints* cp = nullptr);
+    bool parse_me(Samples& M, forest& output, const ParseLimit& lim = {});
     void setMaxHypothesis(unsigned n);
     unsigned getMaxHypothesis() const;
+    void setConcurrentClassifiers(bool enable, executor exec);
+    void setClassifierCascade(float top, float margin, bool audit);
+    void setVocabulary(std::span<const std::string> symbols);
+    void setSegmentPruning(float min_prob, float min_score);
+    void setBestFirst(bool enable, std::size_t max_items);
+    void setSearchWindows(const search_windows& w);
+    const search_windows& getSearchWindows() const;
+    void setCalibration(WindowCalibration* into);
+    // Lower the effort of parses expected to take longer than `target` (0 = always full)
+    void setLatencyTarget(std::chrono::nanoseconds target);
+    parse_effort getEffort() const;
+    const statistics& getStatistics() const;
+    void resetStatistics();
+    // Move the statistics of another parser into these
+    void mergeStatistics(meParser& other);
 };
 
 }
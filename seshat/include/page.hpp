@@ -0,0 +1,41 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef _PAGE_
+#define _PAGE_
+
+#include "stroke.hpp"
+#include <span>
+#include <vector>
+
+namespace seshat {
+
+// Strokes of a page that are parsed as a separate expression
+struct PageRegion {
+    std::vector<int> strokes; // In the order they were drawn
+    int rx, ry, rs, rt; // Bounding box
+};
+
+// Two strokes belong to the same region when the gap between their bounding boxes is at most
+// `hgap` times the reference symbol width horizontally and `vgap` times its height vertically.
+// Regions are returned in reading order: by lines of text (regions that overlap vertically)
+// from top to bottom, each one from left to right
+std::vector<PageRegion> segmentPage(std::span<const Stroke> strokes, float hgap, float vgap);
+
+}
+
+#endif
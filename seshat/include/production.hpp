@@ -22,6 +22,7 @@
 #include <memory>
 #include <ostream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace seshat {
@@ -33,9 +34,17 @@ class InternalHypothesis;
 class ProductionB {
 protected:
     std::string outStr;
+    int pos1{ -1 }, pos2{ -1 }; // first occurrences of $1 and $2 in outStr
     char merge_cen;
 
 public:
+    // outStr split around its subtrees: text[0] child[0] text[1] child[1] text[2],
+    // where a child is 0 for the left subtree, 1 for the right one and -1 if absent
+    struct OutLayout {
+        std::string_view text[3];
+        int child[2]{ -1, -1 };
+    };
+
     ProductionB(int s, int a, int b);
     ProductionB(int s, int a, int b, float pr, const std::string& out);
 
@@ -45,12 +54,13 @@ public:
 
     virtual ~ProductionB() = default;
 
-    float solape(InternalHypothesis* a, InternalHypothesis* b);
+    float solape(const InternalHypothesis* a, const InternalHypothesis* b);
     void printOut(std::ostream& os, Grammar& G, const InternalHypothesis* H);
     void setMerges(char c);
     void mergeRegions(InternalHypothesis* a, InternalHypothesis* b, InternalHypothesis* s);
     bool check_out();
     const std::string& get_outstr() const;
+    OutLayout layout() const;
 
     // Pure virtual functions
     virtual char tipo() const = 0;
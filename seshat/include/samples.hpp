@@ -24,6 +24,7 @@
 #include <climits>
 #include <cstdio>
 #include <span>
+#include <utility>
 #include <vector>
 
 namespace seshat {
@@ -47,20 +48,35 @@ class Samples {
     friend math_expression;
 
     std::vector<Stroke> dataon;
+    // Coordinates of every stroke, one after the other, unless borrowed from the caller
+    std::vector<float> xs, ys;
+    int nfinished{ 0 }; // Strokes whose per-stroke data is complete
     VectorImagef stk_dis;
 
     VectorImage dataoff;
     int IMGxMIN, IMGyMIN, IMGxMAX, IMGyMAX;
     VectorImage pix_stk;
-    std::vector<int> vmedx, vmedy;
 
     void linea(VectorImage& img, Point* pa, Point* pb, int stkid);
     void linea_pbm(VectorImage& img, Point* pa, Point* pb, int stkid);
-    bool not_visible(int si, int sj, Point* pi, Point* pj);
+    bool not_visible(int si, int sj, const Point& pi, const Point& pj);
 
     void clearAll();
     void makeReady();
     void render();
+    void rebase();
+    void updateClosest(int np, const Point& p);
+
+    // Strokes are added point by point, computing what only depends on them (and on the
+    // previous strokes) as the points arrive
+    void beginStroke();
+    void addPoint(const Point& p);
+    void addPoints(std::span<const Point> pts);
+    void endStroke();
+    void removeStroke();
+    // ... or as a whole, either copied to xs/ys or read in place (must outlive the parse)
+    void copyStroke(std::span<const Point> pts);
+    void borrowStroke(std::span<const float> x, std::span<const float> y);
 
 public:
     // Normalized reference symbol size
@@ -81,10 +97,11 @@ public:
     void getAVGstroke_size(float* avgw, float* avgh);
 
     void detRefSymbol();
+    static std::pair<int, int> refSymbol(std::span<const Stroke> strokes);
     void compute_strokes_distances(int rx, int ry);
     float stroke_distance(int si, int sj);
+    float min_dist(int si, int sj);
     float getDist(int si, int sj);
-    void get_close_strokes(int id, std::vector<int>& L, float dist_th);
 
     float group_penalty(CellCYK* A, CellCYK* B);
     bool visibility(std::span<const int> strokes_list);
@@ -23,20 +23,19 @@
 #include <cstdio>
 #include <cstdlib>
 #include <optional>
+#include <span>
 
 namespace seshat {
 
-class CellCYK;
 class Samples;
 
 class SegmentationModelGMM {
-    std::vector<int> strokes_list;
     std::optional<GMM> model;
 
 public:
     SegmentationModelGMM(const fs::path& mod);
 
-    float prob(CellCYK* cd, Samples* m);
+    float prob(std::span<const int> strokes_list, Samples* m);
 };
 
 }
@@ -18,6 +18,8 @@
 #ifndef _SPAREL_
 #define _SPAREL_
 
+#include <cstddef>
+
 namespace seshat {
 
 class InternalHypothesis;
@@ -28,17 +30,20 @@ class SpaRel {
 public:
     static const int NRELS = 6;
     static const int NFEAT = 9;
+    // Largest probability left by smooth()
+    static constexpr double MAX_PROB = (1.0 + 0.02) / (1.0 + NRELS * 0.02);
 
 private:
     GMM& model;
     Samples& mue;
+    std::size_t& scored; // Posteriors computed by the model
     float probs[NRELS];
 
     double compute_prob(InternalHypothesis* h1, InternalHypothesis* h2, int k);
     void smooth(float* post);
 
 public:
-    SpaRel(GMM& gmm, Samples& m);
+    SpaRel(GMM& gmm, Samples& m, std::size_t& scored);
 
     void getFeas(InternalHypothesis* a, InternalHypothesis* b, float* sample, int ry);
 
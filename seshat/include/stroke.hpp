@@ -18,33 +18,68 @@
 #ifndef _STROKE_
 #define _STROKE_
 
+#include "online.hpp"
 #include <climits>
 #include <cstdio>
 #include <cstdlib>
 #include <seshat/point.hpp>
+#include <span>
 #include <vector>
 
 namespace seshat {
 
 class math_expression;
 
+// Closest pair of points to another stroke
+struct Closest {
+    float d2; // Squared distance
+    int pi, pj; // Index of the point in this stroke and in the other one
+};
+
 class Stroke {
     friend math_expression;
+    friend class Samples;
 
-    std::vector<Point> pseq;
+    // Coordinates stored as separate arrays, read in place: either the caller's buffers
+    // (valid while the sample is being parsed) or the ones kept by Samples
+    const float* px;
+    const float* py;
+    int np;
+
+    void include(const Point& p);
 
 public:
-    // Coordinates of the region it defines
-    int rx, ry, rs, rt;
+    // Per-stroke aggregates
+    int rx, ry, rs, rt; // Coordinates of the region it defines
+    int sx, sy; // Sum of the coordinates
     int cx, cy; // Centroid
 
+    // Set once the stroke is complete
+    std::vector<sent_point> filtered; // No repeated points and median filtered (online features)
+    std::vector<Closest> closest; // To every previous stroke
+
     Stroke();
 
-    Point* get(int idx);
-    const Point* get(int idx) const;
-    int getNPoints() const;
+    Point get(int idx) const
+    {
+        return { px[idx], py[idx] };
+    }
+    int getNPoints() const
+    {
+        return np;
+    }
+    std::span<const float> xs() const
+    {
+        return { px, std::size_t(np) };
+    }
+    std::span<const float> ys() const
+    {
+        return { py, std::size_t(np) };
+    }
 
-    float min_dist(Stroke* st);
+    void borrow(std::span<const float> xs, std::span<const float> ys);
+    void add(const Point& p); // Already stored right after the current points
+    void finish();
 };
 
 }
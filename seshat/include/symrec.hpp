@@ -22,12 +22,15 @@
 #include "symfeatures.hpp"
 #include <cstdio>
 #include <cstring>
+#include <future>
 #include <map>
 #include <rnnlib4seshat/DataExporter.hpp>
 #include <rnnlib4seshat/DataSequence.hpp>
 #include <rnnlib4seshat/Mdrnn.hpp>
 #include <rnnlib4seshat/NetcdfDataset.hpp>
 #include <rnnlib4seshat/WeightContainer.hpp>
+#include <seshat/executor.hpp>
+#include <seshat/statistics.hpp>
 #include <span>
 #include <string>
 #include <utility>
@@ -50,14 +53,30 @@ class SymRec {
     std::vector<SymbolType> type;
     std::map<std::string, int> cl2key;
     std::vector<std::string> key2cl;
+    std::vector<int> label2key; // BLSTM output index to class id (same for online and offline)
+    std::vector<int> activeLabels; // BLSTM outputs of the allowed classes
+    bool restricted;
 
     int C; // Number of classes
 
+    // Evaluate the online and offline classifiers concurrently
+    bool concurrent;
+    executor exec;
+
+    // Cascade: skip the offline classifier when the online top posterior (or its
+    // margin over the runner-up) exceeds these values. Disabled when <= 0
+    float cascadeTH, cascadeMargin;
+    bool cascadeAudit; // still run the offline classifier and count agreements
+
+    statistics& stats;
+
     int classify(Samples& M, SegmentHyp& SegHyp, const int NB, int* vclase, float* vpr, int& as, int& ds);
     void BLSTMclassification(Mdrnn* net, const DataSequence& seq, std::span<std::pair<float, int>>);
+    std::future<void> launch(std::function<void()> task);
+    bool onlineSuffices(std::span<const std::pair<float, int>> clason) const;
 
 public:
-    SymRec(const fs::path& path);
+    SymRec(const fs::path& path, statistics& st);
     ~SymRec();
 
     char* strClase(int c);
@@ -65,6 +84,10 @@ public:
     bool checkClase(const std::string& str);
     int getNClases();
     SymbolType symType(int k);
+    void setConcurrent(bool enable, executor ex);
+    void setCascade(float top, float margin, bool audit);
+    // Only rank the classes marked in `clases` (empty allows every class)
+    void setVocabulary(const std::vector<bool>& clases);
 
     int clasificar(Samples& M, int ncomp, const int NB, int* vclase, float* vpr, int& as, int& ds);
     int clasificar(Samples& M, std::span<const int> LT, const int NB, int* vclase, float* vpr, int& as, int& ds);
@@ -25,7 +25,6 @@
 #include <climits>
 #include <cstdio>
 #include <map>
-#include <optional>
 #include <vector>
 
 namespace seshat {
@@ -72,16 +71,11 @@ struct coo {
     }
 };
 
-struct InternalOptHypothesis {
-    // InternalHypothesis that accounts for the target (input) math expression
-    std::optional<InternalHypothesis> Target{ std::nullopt };
-    // Percentage of strokes covered by the most likely hypothesis (target)
-    int pm_comps{ 0 };
-};
 class TableCYK {
     std::vector<CellCYK*> T;
     std::vector<std::map<coo, CellCYK*>> TS;
     int N, K;
+    int nhyps;
 
 public:
     TableCYK(int n, int k);
@@ -89,14 +83,14 @@ public:
 
     void SetNumHypotheses(int amount);
     int NumHypotheses() const;
-    InternalHypothesis* getMLH(int n);
+    // Whether the derivations add() discards are kept as alternatives for k-best extraction
+    bool keepsAlternatives() const;
     CellCYK* get(int n);
     int size(int n);
-    void updateTarget(const InternalHypothesis& H);
-    void add(int n, CellCYK* celda, int noterm_id, bool* esinit);
-
-private:
-    std::vector<InternalOptHypothesis> Targets;
+    void add(int n, CellCYK* celda, int noterm_id);
+    bool rejects(int n, const CellCYK* A, const CellCYK* B, int noterm_id, float pr) const;
+    // Hypotheses of the start symbols, over every cell of the table
+    std::vector<const InternalHypothesis*> roots(const bool* esinit) const;
 };
 
 }
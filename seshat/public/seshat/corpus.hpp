@@ -0,0 +1,90 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SESHAT_PUBLIC_INTERFACE_CORPUS
+#define SESHAT_PUBLIC_INTERFACE_CORPUS
+
+#include <cstdint>
+#include <seshat/seshat.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace seshat {
+
+// Many samples (and optionally their labels) packed in a single file, read without copying.
+// Layout, little endian, every section starting at a multiple of 8 bytes:
+//   header: "SESHATIC", u32 version, u32 encoding, u64 samples, u64 strokes, u64 points,
+//           u64 label bytes, f32 origin x, f32 origin y, f32 scale, u32 unused
+//   u64 first stroke of every sample, and one past the last
+//   u64 first point of every stroke, and one past the last
+//   u64 first label byte of every sample, and one past the last, then the label bytes
+//   x of every point, then y: float32, or int16 meaning origin + scale * (q + 32768)
+class corpus {
+public:
+    enum class encoding : std::uint32_t {
+        float32,
+        int16, // int16 files are expanded to float once, when opened
+    };
+
+    // Throws if the file can't be read or isn't a well-formed corpus
+    explicit corpus(const char* path);
+    ~corpus();
+
+    corpus(const corpus&) = delete;
+    corpus& operator=(const corpus&) = delete;
+
+    std::size_t size() const;
+    sample_view operator[](std::size_t i) const;
+    std::string_view label(std::size_t i) const;
+    // Every sample, e.g. for math_expression::parse_batch
+    std::vector<sample_view> views() const;
+
+private:
+    const char* data{ nullptr };
+    std::size_t bytes{ 0 };
+    std::vector<char> contents; // when the file can't be mapped
+
+    std::uint64_t nsamples{ 0 };
+    const std::uint64_t* sample_strokes{ nullptr };
+    const std::uint64_t* stroke_points{ nullptr };
+    const std::uint64_t* label_offsets{ nullptr };
+    const char* labels{ nullptr };
+    const float* x{ nullptr };
+    const float* y{ nullptr };
+    std::vector<float> decoded; // int16 coordinates as float
+};
+
+// Builds a corpus file out of samples
+class corpus_writer {
+    std::vector<std::uint64_t> sample_strokes{ 0 };
+    std::vector<std::uint64_t> stroke_points{ 0 };
+    std::vector<std::uint64_t> label_offsets{ 0 };
+    std::string labels;
+    std::vector<float> x, y;
+
+public:
+    void add(const sample& s, std::string_view label = {});
+    std::size_t size() const;
+    // Throws if the file can't be written. int16 is lossless for integer coordinates
+    // spanning less than 65536 units, and otherwise quantizes them
+    void write(const char* path, corpus::encoding enc = corpus::encoding::float32) const;
+};
+
+}
+
+#endif
@@ -0,0 +1,32 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SESHAT_PUBLIC_INTERFACE_EFFORT
+#define SESHAT_PUBLIC_INTERFACE_EFFORT
+
+namespace seshat {
+
+// How much search a parse did, picked per input to meet the latency target
+enum class parse_effort {
+    full, // as configured
+    reduced, // 5 classes per symbol, symbols of up to 3 strokes, unlikely segmentations skipped
+    minimal, // 2 classes per symbol, symbols of up to 2 strokes, only likely segmentations
+};
+
+}
+
+#endif
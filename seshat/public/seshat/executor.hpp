@@ -0,0 +1,31 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SESHAT_PUBLIC_INTERFACE_EXECUTOR
+#define SESHAT_PUBLIC_INTERFACE_EXECUTOR
+
+#include <functional>
+
+namespace seshat {
+
+// Runs a task, now or later, on any thread (e.g. by posting it to a thread pool).
+// Every task handed over must eventually be run exactly once.
+using executor = std::function<void(std::function<void()>)>;
+
+}
+
+#endif
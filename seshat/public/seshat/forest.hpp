@@ -0,0 +1,53 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SESHAT_PUBLIC_INTERFACE_FOREST
+#define SESHAT_PUBLIC_INTERFACE_FOREST
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace seshat {
+
+// Derivations of all the hypotheses of a parse, sharing their common subtrees.
+// Strings are interned, and LaTeX is only rendered for the hypotheses asked for
+struct forest {
+    struct node {
+        std::uint32_t symbol{ 0 }; // grammar non-terminal, id into `strings`
+        // Output as text[0] child[0] text[1] child[1] text[2]. A terminal symbol is just its
+        // TeX in text[0]. Ids into `strings` and `nodes` (-1 for an absent child)
+        std::uint32_t text[3]{};
+        std::int32_t child[2]{ -1, -1 };
+    };
+
+    std::vector<std::string> strings; // strings[0] is always empty
+    std::vector<node> nodes; // children always come before their parents
+    std::vector<std::uint32_t> roots; // node of each hypothesis, most likely first
+    std::vector<double> scores; // log-probability of each hypothesis
+
+    std::size_t size() const;
+    void clear();
+
+    // LaTeX string of hypothesis i
+    std::string latex(std::size_t i) const;
+    void latex(std::size_t i, std::string& out) const;
+};
+
+}
+
+#endif
@@ -85,6 +85,9 @@ struct hypothesis {
      * id 5, 2 {} (no children, leaf)
      */
 #else
+    hypothesis(const hypothesis&) = default;
+    hypothesis& operator=(const hypothesis&) = default;
+
     std::string repr;
 #endif
 };
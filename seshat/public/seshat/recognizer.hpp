@@ -0,0 +1,92 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SESHAT_PUBLIC_INTERFACE_RECOGNIZER
+#define SESHAT_PUBLIC_INTERFACE_RECOGNIZER
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <seshat/seshat.hpp>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace seshat {
+
+// Parses samples on a worker thread. Only the latest submitted sample matters: submitting
+// a new one drops the pending one and stops the parse in flight, whose result is discarded.
+// Samples are parsed with math_expression::parse_strokes, feeding only the strokes that differ
+// from the previous sample, so undoing or adding the last strokes reuses its checkpoints
+class async_recognizer {
+public:
+    struct result {
+        std::uint64_t id; // as returned by submit
+        std::vector<hypothesis> hypotheses;
+        std::exception_ptr error; // set, with no hypotheses, if the parse threw
+    };
+    // Called on the worker thread instead of storing results for take
+    using callback = std::function<void(result&&)>;
+
+    // `recog` is used by the worker only, and must outlive this object
+    explicit async_recognizer(math_expression& recog, callback on_result = {});
+    ~async_recognizer();
+
+    async_recognizer(const async_recognizer&) = delete;
+    async_recognizer& operator=(const async_recognizer&) = delete;
+
+    // Queue a copy of the sample, without waiting for the worker
+    std::uint64_t submit(sample s);
+    // Latest result not taken yet, if any
+    std::optional<result> take();
+    // Whether a submitted sample is still waiting or being parsed
+    bool busy() const;
+
+private:
+    struct request {
+        std::uint64_t id;
+        sample s;
+    };
+
+    void work(std::stop_token stop);
+    void feed(sample& s);
+
+    math_expression& recog;
+    callback on_result;
+    std::vector<sample::stroke> fed; // strokes of the last sample given to recog (worker only)
+
+    std::mutex mtx;
+    std::condition_variable_any wake;
+    std::unique_ptr<request> pending;
+    std::stop_source inflight;
+    std::atomic<std::uint64_t> submitted{ 0 };
+    std::atomic<std::uint64_t> finished{ 0 }; // id of the last request handled
+
+    // Single slot mailbox, swapped in and out whole
+    std::atomic<result*> mailbox{ nullptr };
+
+    std::jthread worker;
+};
+
+}
+
+#endif
@@ -18,13 +18,32 @@
 #ifndef SESHAT_PUBLIC_INTERFACE
 #define SESHAT_PUBLIC_INTERFACE
 
+#include <cfloat>
+#include <chrono>
+#include <cstdint>
 #include <memory>
+#include <seshat/effort.hpp>
+#include <seshat/executor.hpp>
+#include <seshat/forest.hpp>
 #include <seshat/hypothesis.hpp>
 #include <seshat/point.hpp>
+#include <seshat/statistics.hpp>
+#include <seshat/windows.hpp>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 namespace seshat {
 
+// Whether a parse ran to completion or was cut short
+enum class parse_status {
+    complete,
+    partial,
+};
+
 struct sample {
     struct stroke {
         std::vector<point> points;
@@ -33,23 +52,143 @@ struct sample {
     std::size_t total_points{ 0 };
 };
 
+// Sample borrowed from elsewhere (e.g. a corpus), coordinates stored as separate arrays
+struct sample_view {
+    // One more than the strokes: stroke k holds points [offsets[k], offsets[k + 1]) - offsets[0]
+    std::span<const std::uint64_t> offsets;
+    std::span<const float> x, y;
+
+    std::size_t size() const
+    {
+        return offsets.empty() ? 0 : offsets.size() - 1;
+    }
+    std::span<const float> stroke_x(std::size_t k) const
+    {
+        return x.subspan(offsets[k] - offsets[0], offsets[k + 1] - offsets[k]);
+    }
+    std::span<const float> stroke_y(std::size_t k) const
+    {
+        return y.subspan(offsets[k] - offsets[0], offsets[k + 1] - offsets[k]);
+    }
+};
+
+// An expression found on a page by parse_page
+struct page_region {
+    std::vector<std::size_t> strokes; // Indices of its strokes in the page
+    int x, y, s, t; // Bounding box, top-left (x, y) to bottom-right (s, t)
+    std::vector<hypothesis> hypotheses;
+};
+
 // do not use these, forward declarations for the inner workings
 class meParser;
 class Samples;
+class Checkpoints;
 
 // only this
 class math_expression {
     std::unique_ptr<meParser> parser;
     std::unique_ptr<Samples> samples;
+    std::unique_ptr<Samples> ink; // strokes fed with begin_stroke/add_points/end_stroke
+    std::unique_ptr<Checkpoints> checkpoints;
+
+    // Extra parsers for parse_batch, configured like the main one
+    struct worker;
+    std::string config;
+    std::vector<std::pair<std::string_view, std::function<void(meParser&)>>> settings; // latest of each
+    std::vector<std::unique_ptr<worker>> workers;
+    float page_hgap{ 2.0f }, page_vgap{ 0.6f };
+    parse_effort effort{ parse_effort::full };
+
+    void configure(std::string_view name, std::function<void(meParser&)> setting);
+    void load_sample(const sample&);
+    static void load_sample(Samples& into, const sample&);
+    // The points are read in place, the input must outlive the parse
+    static void load_sample(Samples& into, const sample_view&);
+    std::vector<std::vector<hypothesis>> parse_many(std::size_t count, const std::function<std::size_t(std::size_t)>& strokes, const std::function<void(Samples&, std::size_t)>& load, unsigned threads, std::span<std::chrono::nanoseconds> times);
 
 public:
     explicit math_expression(const char* config_path = "Config/CONFIG");
     ~math_expression();
 
     void want_max_hypothesis(unsigned amount);
+    // Run the online and offline symbol classifiers at the same time, on a new thread
+    // or as tasks handed to `exec`. While the classifier cascade is enabled they still run
+    // one after the other, since the online result decides whether the offline one runs
+    void want_concurrent_classifiers(bool enable, executor exec = {});
+    // Skip the offline symbol classifier when the online top posterior exceeds `top`
+    // or its margin over the runner-up exceeds `margin` (<= 0 disables a criterion).
+    // In audit mode both classifiers still run and the decisions are only counted
+    void want_classifier_cascade(float top, float margin, bool audit = false);
+    // Only recognize the given symbol classes (as named in the symbol types file),
+    // dropping the grammar rules that can no longer be used. Empty allows every symbol
+    void want_symbols(const std::vector<std::string>& symbols);
+    // Don't classify multi-stroke segmentations whose segmentation probability is below
+    // `min_prob`, or whose best possible (log) terminal score is below `min_score`.
+    // Throws if `min_prob` is not in [0, 1)
+    void want_segment_pruning(float min_prob, float min_score = -FLT_MAX);
+    // When a single hypothesis is wanted, search it best-first (A*) before filling the whole
+    // CYK chart, which is still used if no parse covers every stroke within `max_items` popped
+    // hypotheses (0 = no limit)
+    void want_best_first(bool enable, std::size_t max_items = 100000);
+    // Memory (approximately, in bytes) for what parse_strokes keeps between calls: the classifier
+    // results of every segmentation and the hypotheses found for each number of strokes. Parsing
+    // again after removing strokes returns the stored hypotheses; after adding strokes only the
+    // new segmentations are classified, but the parsing table is built again.
+    // 0 disables it, the default is 8 MiB
+    void want_checkpoints(std::size_t max_bytes);
+    // Regions where the second member of each spatial relation is looked for
+    void want_search_windows(const search_windows& windows);
+    // Parse a calibration corpus and return the windows that hold the given quantile of the
+    // spatial relations of its best parses, for want_search_windows. The windows no relation
+    // used are left as they are, the others can only shrink
+    search_windows calibrate_search_windows(std::span<const sample> corpus, float quantile = 1.0f);
+    // Estimate the time of each parse from its number of strokes and how many are close to
+    // each other, and search less (see parse_effort) when it would exceed `target`. How long
+    // each effort level takes is learnt from the parses run. 0, the default, always searches fully
+    void want_latency_target(std::chrono::nanoseconds target);
+    // Effort of the last parse_sample or parse_strokes
+    parse_effort last_effort() const;
+
+    const statistics& get_statistics() const;
+    void reset_statistics();
 
     std::vector<hypothesis> parse_sample(const sample&);
     void parse_sample(const sample&, std::vector<hypothesis>&);
+    // All the hypotheses as a single forest, LaTeX rendered on demand with forest::latex
+    void parse_sample(const sample&, forest&);
+    void parse_sample(const sample_view&, std::vector<hypothesis>&);
+    // Give up when a stop is requested or at the deadline (checked between chunks of work),
+    // returning the hypotheses found so far that cover the most strokes
+    parse_status parse_sample(const sample&, std::vector<hypothesis>&, std::stop_token);
+    parse_status parse_sample(const sample&, std::vector<hypothesis>&, std::chrono::steady_clock::time_point deadline);
+
+    // Feed the strokes as they are drawn: the work that only depends on a stroke and the
+    // previous ones is done while its points arrive, leaving classification and parsing
+    // for parse_strokes
+    void begin_stroke();
+    void add_points(std::span<const point>);
+    void end_stroke();
+    void remove_last_stroke();
+    void clear_strokes();
+    std::size_t stroke_count() const;
+    void parse_strokes(std::vector<hypothesis>&);
+    // Give up when a stop is requested, as parse_sample does. Partial results aren't kept
+    parse_status parse_strokes(std::vector<hypothesis>&, std::stop_token);
+
+    // Parse many samples on `threads` threads (0 = one per hardware thread), the largest
+    // first. Each thread but the calling one uses its own parser, loaded from the
+    // configuration on first use and kept for later batches. Results are in input order,
+    // as are the parse times written to `times` when it isn't empty
+    std::vector<std::vector<hypothesis>> parse_batch(std::span<const sample> inputs, unsigned threads = 0, std::span<std::chrono::nanoseconds> times = {});
+    std::vector<std::vector<hypothesis>> parse_batch(std::span<const sample_view> inputs, unsigned threads = 0, std::span<std::chrono::nanoseconds> times = {});
+
+    // A page holding several expressions is split into regions: strokes whose bounding boxes
+    // are less than `horizontal` times the reference symbol width apart horizontally and
+    // `vertical` times its height vertically are in the same one. Defaults are 2 and 0.6
+    void want_page_gaps(float horizontal, float vertical);
+    // Parse each region of a page as a separate expression, as parse_batch does.
+    // Regions are in reading order (top to bottom, then left to right)
+    std::vector<page_region> parse_page(const sample& page, unsigned threads = 0);
 };
 
 }
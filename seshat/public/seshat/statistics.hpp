@@ -0,0 +1,89 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SESHAT_PUBLIC_INTERFACE_STATISTICS
+#define SESHAT_PUBLIC_INTERFACE_STATISTICS
+
+#include <chrono>
+#include <cstddef>
+
+namespace seshat {
+
+// Counters accumulated over every parse until reset
+struct statistics {
+    // Symbol classification
+    std::size_t classifications{ 0 }; // segmentation hypotheses classified
+    std::size_t classifications_cached{ 0 }; // classifier results reused from a previous parse
+    std::size_t offline_skipped{ 0 }; // of which the cascade judged the online classifier sufficient
+    std::size_t cascade_audited{ 0 }; // cascade decisions checked against both classifiers (audit mode)
+    std::size_t cascade_agreed{ 0 }; // of which the online top-1 matched the combined top-1
+    std::chrono::nanoseconds online_time{ 0 }; // online features + online BLSTM
+    std::chrono::nanoseconds offline_time{ 0 }; // rendering + offline features + offline BLSTM
+
+    // Multi-stroke segmentation hypotheses discarded before classification
+    std::size_t segments{ 0 }; // connected stroke subsets considered
+    std::size_t segments_implausible{ 0 }; // bounding box too large for a symbol
+    std::size_t segments_low_prob{ 0 }; // segmentation probability below the threshold
+    std::size_t segments_bounded{ 0 }; // best possible terminal score below the threshold
+
+    // Binary production combinations discarded before scoring their spatial relation
+    std::size_t fusions_bounded{ 0 }; // a better hypothesis already covers the region
+    std::size_t fusions_dead{ 0 }; // the grammar can't fit the result in a parse of every stroke
+    std::size_t relations_scored{ 0 }; // spatial relation posteriors computed for the rest
+
+    // Terminal productions not applied to a segmentation hypothesis
+    std::size_t terminals_dead{ 0 }; // the grammar can't fit the symbol in a parse of every stroke
+
+    // Best-first parsing
+    std::size_t agenda_popped{ 0 }; // hypotheses popped from the agenda
+    std::size_t agenda_fallbacks{ 0 }; // parses left to the CYK chart (no full parse, or over budget)
+
+    std::size_t partial_parses{ 0 }; // parses cut short by a stop request or a deadline
+
+    // Parses run below full effort to meet the latency target
+    std::size_t parses_reduced{ 0 };
+    std::size_t parses_minimal{ 0 };
+
+    statistics& operator+=(const statistics& o)
+    {
+        classifications += o.classifications;
+        classifications_cached += o.classifications_cached;
+        offline_skipped += o.offline_skipped;
+        cascade_audited += o.cascade_audited;
+        cascade_agreed += o.cascade_agreed;
+        online_time += o.online_time;
+        offline_time += o.offline_time;
+        segments += o.segments;
+        segments_implausible += o.segments_implausible;
+        segments_low_prob += o.segments_low_prob;
+        segments_bounded += o.segments_bounded;
+        fusions_bounded += o.fusions_bounded;
+        fusions_dead += o.fusions_dead;
+        relations_scored += o.relations_scored;
+        terminals_dead += o.terminals_dead;
+        agenda_popped += o.agenda_popped;
+        agenda_fallbacks += o.agenda_fallbacks;
+        partial_parses += o.partial_parses;
+        parses_reduced += o.parses_reduced;
+        parses_minimal += o.parses_minimal;
+        return *this;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,45 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SESHAT_PUBLIC_INTERFACE_WINDOWS
+#define SESHAT_PUBLIC_INTERFACE_WINDOWS
+
+namespace seshat {
+
+// Regions where the second member of each spatial relation is looked for, around the region
+// of the first one, in units of the reference symbol width (RX) and height (RY)
+struct search_windows {
+    // Horizontal, superscript and subscript: to the right
+    float right{ 8 }; // RX past its right side
+    float back{ 2 }; // RX back from its right side
+    float rise{ 1 }; // RY above its top and below its bottom
+    // Vertical: below (or above, from the lower member)
+    float below{ 3 }; // RY past its bottom
+    float overlap{ 1 }; // RY back from its bottom
+    float side{ 2 }; // RX to each side
+    // Inside a square root
+    float inside_right{ 1 }; // RX past its right side
+    float inside_below{ 1 }; // RY past its bottom
+    // Index of an n-th root
+    float index_side{ 2 }; // RX to each side of its left side
+    float index_above{ 1 }; // RY above its top
+    float index_below{ 2 }; // RY below its top
+};
+
+}
+
+#endif
@@ -0,0 +1,125 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <agenda.hpp>
+#include <algorithm>
+#include <limits>
+
+using namespace seshat;
+
+Agenda::Agenda(int n, int k)
+    : nstrokes{ n }
+    , nnt{ k }
+    , strokeBound(n, -std::numeric_limits<double>::infinity())
+    , totalBound{ 0 }
+    , byNoTerm(k)
+{
+}
+
+void Agenda::bound(const CellCYK* c)
+{
+    const int size = std::count(c->ccc.get(), c->ccc.get() + c->nc, true);
+
+    // A terminal of score p covering m strokes contributes at most p/m per stroke
+    for (const auto& [nt, H] : c->noterm)
+        for (int i = 0; i < nstrokes; i++)
+            if (c->ccc[i])
+                strokeBound[i] = std::max(strokeBound[i], H.pr / size);
+}
+
+bool Agenda::seal()
+{
+    totalBound = 0;
+    for (double b : strokeBound) {
+        if (b == -std::numeric_limits<double>::infinity())
+            return false;
+        totalBound += b;
+    }
+    return true;
+}
+
+Agenda::Cell& Agenda::lookup(const CellCYK* c)
+{
+    std::vector<bool> key(c->ccc.get(), c->ccc.get() + c->nc);
+
+    auto [it, fresh] = cells.try_emplace(std::move(key));
+    Cell& cell = it->second;
+    if (fresh) {
+        cell.cell = std::make_unique<CellCYK>(nnt, nstrokes);
+        cell.cell->x = c->x;
+        cell.cell->y = c->y;
+        cell.cell->s = c->s;
+        cell.cell->t = c->t;
+        std::copy_n(c->ccc.get(), c->nc, cell.cell->ccc.get());
+        cell.cell->talla = std::count(c->ccc.get(), c->ccc.get() + c->nc, true);
+
+        // Strokes left out can add at most their bound
+        cell.outside = totalBound;
+        for (int i = 0; i < nstrokes; i++)
+            if (c->ccc[i])
+                cell.outside -= strokeBound[i];
+    }
+
+    return cell;
+}
+
+bool Agenda::isClosed(const Cell& cell, int nt)
+{
+    return std::any_of(cell.closed.begin(), cell.closed.end(), [nt](const auto& e) { return e.first == nt; });
+}
+
+void Agenda::push(const CellCYK* c, const InternalHypothesis& H)
+{
+    Cell& cell = lookup(c);
+    if (isClosed(cell, H.ntid))
+        return;
+
+    const InternalHypothesis* pending = cell.cell->noterm[H.ntid];
+    if (pending && pending->pr >= H.pr)
+        return;
+
+    InternalHypothesis* P = cell.cell->noterm.set(H.ntid, H);
+    P->parent = cell.cell.get();
+
+    queue.push({ P->pr + cell.outside, seq++, &cell, *P });
+}
+
+InternalHypothesis* Agenda::pop()
+{
+    while (!queue.empty()) {
+        const InternalHypothesis H = queue.top().H;
+        Cell& cell = *queue.top().cell;
+        queue.pop();
+
+        // Skip hypotheses already popped or improved since they were pushed
+        if (isClosed(cell, H.ntid) || cell.cell->noterm[H.ntid]->pr > H.pr)
+            continue;
+
+        InternalHypothesis* P = &closed.emplace_back(H);
+        cell.closed.emplace_back(H.ntid, P);
+        byNoTerm[H.ntid].push_back(P);
+        return P;
+    }
+
+    return nullptr;
+}
+
+bool Agenda::coversAll(const InternalHypothesis* H) const
+{
+    return H->parent->talla == nstrokes;
+}
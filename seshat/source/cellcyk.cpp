@@ -16,11 +16,93 @@
     along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <cellcyk.hpp>
 #include <cstring>
+#include <utility>
 
 using namespace seshat;
 
+std::vector<NoTermSet::Entry>::iterator NoTermSet::find(int nt)
+{
+    return std::lower_bound(entries.begin(), entries.end(), nt, [](const Entry& e, int id) { return e.nt < id; });
+}
+
+std::vector<NoTermSet::Entry>::const_iterator NoTermSet::find(int nt) const
+{
+    return std::lower_bound(entries.begin(), entries.end(), nt, [](const Entry& e, int id) { return e.nt < id; });
+}
+
+bool NoTermSet::masked(int nt) const
+{
+    return nt < MASK_BITS && !(mask[nt / 64] >> (nt % 64) & 1);
+}
+
+InternalHypothesis* NoTermSet::operator[](int nt)
+{
+    if (masked(nt))
+        return nullptr;
+
+    const auto it = find(nt);
+    return it != entries.end() && it->nt == nt ? &it->H : nullptr;
+}
+
+const InternalHypothesis* NoTermSet::operator[](int nt) const
+{
+    if (masked(nt))
+        return nullptr;
+
+    const auto it = find(nt);
+    return it != entries.end() && it->nt == nt ? &it->H : nullptr;
+}
+
+InternalHypothesis* NoTermSet::set(int nt, const InternalHypothesis& H)
+{
+    auto it = find(nt);
+    if (it != entries.end() && it->nt == nt)
+        it->H = H;
+    else
+        it = entries.insert(it, { nt, H });
+
+    if (nt < MASK_BITS)
+        mask[nt / 64] |= std::uint64_t(1) << (nt % 64);
+
+    return &it->H;
+}
+
+void NoTermSet::erase(int nt)
+{
+    const auto it = find(nt);
+    if (it == entries.end() || it->nt != nt)
+        return;
+
+    entries.erase(it);
+
+    if (nt < MASK_BITS)
+        mask[nt / 64] &= ~(std::uint64_t(1) << (nt % 64));
+}
+
+std::vector<NoTermSet::Entry> NoTermSet::take()
+{
+    std::fill_n(mask, MASK_BITS / 64, 0);
+    return std::exchange(entries, {});
+}
+
+bool NoTermSet::empty() const
+{
+    return entries.empty();
+}
+
+std::vector<NoTermSet::Entry>::const_iterator NoTermSet::begin() const
+{
+    return entries.begin();
+}
+
+std::vector<NoTermSet::Entry>::const_iterator NoTermSet::end() const
+{
+    return entries.end();
+}
+
 CellCYK::CellCYK(int n, int ncc)
 {
     sig = nullptr;
@@ -28,9 +110,6 @@ CellCYK::CellCYK(int n, int ncc)
     nc = ncc;
     talla = 0;
 
-    // Create (empty) hypotheses
-    noterm.resize(nnt);
-
     // Create (empty) strokes covered
     ccc = std::make_unique<bool[]>(nc);
     std::fill_n(ccc.get(), nc, false);
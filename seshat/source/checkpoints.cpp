@@ -0,0 +1,145 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <algorithm>
+#include <checkpoints.hpp>
+
+using namespace seshat;
+
+Checkpoints::Checkpoints(std::size_t max_bytes)
+    : limit{ max_bytes }
+{
+}
+
+void Checkpoints::setLimit(std::size_t max_bytes)
+{
+    limit = max_bytes;
+    evict();
+}
+
+std::size_t Checkpoints::memory() const
+{
+    return bytes;
+}
+
+std::size_t Checkpoints::size(const std::vector<int>& key, const Classification& C)
+{
+    return sizeof(C) + 2 * key.size() * sizeof(int) + C.clase.size() * sizeof(int) + C.pr.size() * sizeof(float);
+}
+
+std::size_t Checkpoints::size(const std::vector<hypothesis>& hyps)
+{
+    std::size_t total = sizeof(int) + hyps.size() * sizeof(hypothesis);
+    for (const auto& h : hyps) {
+#ifdef SESHAT_HYPOTHESIS_TREE
+        for (const auto& tok : h.tokens)
+            total += sizeof(tok) + tok.data.size();
+        total += h.relations.size() * sizeof(hypothesis::relation) + h.tree.size() * sizeof(h.tree[0]);
+#else
+        total += h.repr.size();
+#endif
+    }
+    return total;
+}
+
+void Checkpoints::evict()
+{
+    while (bytes > limit && !order.empty()) {
+        const auto& entry = order.front();
+        if (const int* nstrokes = std::get_if<int>(&entry)) {
+            const auto it = results.find(*nstrokes);
+            if (it != results.end()) {
+                bytes -= size(it->second);
+                results.erase(it);
+            }
+        } else {
+            const auto it = classes.find(std::get<std::vector<int>>(entry));
+            if (it != classes.end()) {
+                bytes -= size(it->first, it->second);
+                classes.erase(it);
+            }
+        }
+        order.pop_front();
+    }
+}
+
+const Checkpoints::Classification* Checkpoints::find(std::span<const int> stks) const
+{
+    const auto it = classes.find(std::vector<int>(stks.begin(), stks.end()));
+    return it != classes.end() ? &it->second : nullptr;
+}
+
+void Checkpoints::store(std::span<const int> stks, Classification C)
+{
+    if (!limit)
+        return;
+
+    std::vector<int> key(stks.begin(), stks.end());
+    const std::size_t sz = size(key, C);
+    if (classes.try_emplace(key, std::move(C)).second) {
+        bytes += sz;
+        order.push_back(std::move(key));
+        evict();
+    }
+}
+
+const std::vector<hypothesis>* Checkpoints::result(int nstrokes) const
+{
+    const auto it = results.find(nstrokes);
+    return it != results.end() ? &it->second : nullptr;
+}
+
+void Checkpoints::store(int nstrokes, const std::vector<hypothesis>& hyps)
+{
+    if (!limit || results.contains(nstrokes))
+        return;
+
+    bytes += size(hyps);
+    results.emplace(nstrokes, hyps);
+    order.emplace_back(nstrokes);
+    evict();
+}
+
+void Checkpoints::truncate(int nstrokes)
+{
+    // Stroke ids are sorted, so the last one is the largest
+    std::erase_if(classes, [&](const auto& entry) {
+        if (entry.first.back() < nstrokes)
+            return false;
+        bytes -= size(entry.first, entry.second);
+        return true;
+    });
+    std::erase_if(results, [&](const auto& entry) {
+        if (entry.first <= nstrokes)
+            return false;
+        bytes -= size(entry.second);
+        return true;
+    });
+    std::erase_if(order, [&](const Entry& entry) {
+        if (const int* n = std::get_if<int>(&entry))
+            return *n > nstrokes;
+        return std::get<std::vector<int>>(entry).back() >= nstrokes;
+    });
+}
+
+void Checkpoints::clear()
+{
+    classes.clear();
+    results.clear();
+    order.clear();
+    bytes = 0;
+}
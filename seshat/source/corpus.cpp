@@ -0,0 +1,284 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <seshat/corpus.hpp>
+#include <stdexcept>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace seshat;
+
+namespace {
+
+constexpr char MAGIC[8] = { 'S', 'E', 'S', 'H', 'A', 'T', 'I', 'C' };
+constexpr std::uint32_t VERSION = 1;
+
+struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t encoding;
+    std::uint64_t samples, strokes, points, label_bytes;
+    float origin_x, origin_y, scale;
+    std::uint32_t unused;
+};
+static_assert(sizeof(Header) == 64);
+
+std::size_t align8(std::size_t n)
+{
+    return (n + 7) & ~std::size_t(7);
+}
+
+[[noreturn]] void fail(const std::string& msg)
+{
+    std::cerr << "Error: " << msg << "\n";
+    throw std::runtime_error("Error: " + msg);
+}
+
+}
+
+/**********
+ * corpus *
+ **********/
+
+corpus::corpus(const char* path)
+{
+    if constexpr (std::endian::native != std::endian::little)
+        fail("corpus files can only be read on little endian machines");
+
+#ifndef _WIN32
+    const int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                data = static_cast<const char*>(p);
+                bytes = st.st_size;
+            }
+        }
+        close(fd);
+    }
+#endif
+    if (!data) {
+        std::ifstream fd(path, std::ios::binary);
+        if (!fd)
+            fail(std::string("can't open corpus file '") + path + "'");
+        contents.assign(std::istreambuf_iterator<char>(fd), std::istreambuf_iterator<char>());
+        data = contents.data();
+        bytes = contents.size();
+    }
+
+    Header h;
+    if (bytes < sizeof(h))
+        fail(std::string("'") + path + "' is not a corpus file");
+    std::memcpy(&h, data, sizeof(h));
+    if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) || h.version != VERSION || h.encoding > std::uint32_t(encoding::int16))
+        fail(std::string("'") + path + "' is not a supported corpus file");
+
+    const std::size_t coord = h.encoding == std::uint32_t(encoding::int16) ? sizeof(std::int16_t) : sizeof(float);
+    const auto truncated = [&] {
+        fail(std::string("corpus file '") + path + "' is truncated");
+    };
+    const auto corrupt = [&] {
+        fail(std::string("corpus file '") + path + "' is corrupt");
+    };
+
+    // Counts are checked against the rest of the file before their sizes are computed, so that
+    // these can't wrap around
+    if (h.samples >= bytes || h.strokes >= bytes)
+        truncated();
+    std::size_t off = sizeof(h);
+    const auto section = [&](std::uint64_t count, std::size_t each) {
+        if (off > bytes || count > (bytes - off) / each)
+            truncated();
+        const std::size_t at = off;
+        off += align8(count * each);
+        return at;
+    };
+    const std::size_t samples_at = section(h.samples + 1, sizeof(std::uint64_t));
+    const std::size_t strokes_at = section(h.strokes + 1, sizeof(std::uint64_t));
+    const std::size_t label_offsets_at = section(h.samples + 1, sizeof(std::uint64_t));
+    const std::size_t labels_at = section(h.label_bytes, 1);
+    const std::size_t x_at = section(h.points, coord);
+    const std::size_t y_at = section(h.points, coord);
+    if (off > bytes)
+        truncated();
+
+    nsamples = h.samples;
+    sample_strokes = reinterpret_cast<const std::uint64_t*>(data + samples_at);
+    stroke_points = reinterpret_cast<const std::uint64_t*>(data + strokes_at);
+    label_offsets = reinterpret_cast<const std::uint64_t*>(data + label_offsets_at);
+    labels = data + labels_at;
+
+    // Every index is used unchecked later: each table has to run from 0 to the end of what it indexes
+    const auto valid = [](const std::uint64_t* table, std::uint64_t n, std::uint64_t end) {
+        return table[0] == 0 && table[n] == end && std::is_sorted(table, table + n + 1);
+    };
+    if (!valid(sample_strokes, h.samples, h.strokes) || !valid(stroke_points, h.strokes, h.points) || !valid(label_offsets, h.samples, h.label_bytes))
+        corrupt();
+
+    if (h.encoding == std::uint32_t(encoding::int16)) {
+        decoded.resize(2 * h.points);
+        const auto qx = reinterpret_cast<const std::int16_t*>(data + x_at);
+        const auto qy = reinterpret_cast<const std::int16_t*>(data + y_at);
+        for (std::uint64_t i = 0; i < h.points; i++) {
+            decoded[i] = h.origin_x + h.scale * (qx[i] + 32768.0f);
+            decoded[h.points + i] = h.origin_y + h.scale * (qy[i] + 32768.0f);
+        }
+        x = decoded.data();
+        y = decoded.data() + h.points;
+    } else {
+        x = reinterpret_cast<const float*>(data + x_at);
+        y = reinterpret_cast<const float*>(data + y_at);
+    }
+}
+
+corpus::~corpus()
+{
+#ifndef _WIN32
+    if (data && contents.empty())
+        munmap(const_cast<char*>(data), bytes);
+#endif
+}
+
+std::size_t corpus::size() const
+{
+    return nsamples;
+}
+
+sample_view corpus::operator[](std::size_t i) const
+{
+    const auto first = sample_strokes[i], last = sample_strokes[i + 1];
+    const auto p0 = stroke_points[first], p1 = stroke_points[last];
+
+    sample_view view;
+    view.offsets = { stroke_points + first, last - first + 1 };
+    view.x = { x + p0, p1 - p0 };
+    view.y = { y + p0, p1 - p0 };
+    return view;
+}
+
+std::string_view corpus::label(std::size_t i) const
+{
+    return { labels + label_offsets[i], label_offsets[i + 1] - label_offsets[i] };
+}
+
+std::vector<sample_view> corpus::views() const
+{
+    std::vector<sample_view> out;
+    out.reserve(nsamples);
+    for (std::size_t i = 0; i < nsamples; i++)
+        out.push_back((*this)[i]);
+    return out;
+}
+
+/*****************
+ * corpus_writer *
+ *****************/
+
+void corpus_writer::add(const sample& s, std::string_view label)
+{
+    for (const auto& stk : s.strokes) {
+        for (const auto& p : stk.points) {
+            x.push_back(p.x);
+            y.push_back(p.y);
+        }
+        stroke_points.push_back(x.size());
+    }
+    sample_strokes.push_back(stroke_points.size() - 1);
+
+    labels += label;
+    label_offsets.push_back(labels.size());
+}
+
+std::size_t corpus_writer::size() const
+{
+    return sample_strokes.size() - 1;
+}
+
+void corpus_writer::write(const char* path, corpus::encoding enc) const
+{
+    if constexpr (std::endian::native != std::endian::little)
+        fail("corpus files can only be written on little endian machines");
+
+    std::ofstream fd(path, std::ios::binary);
+    if (!fd)
+        fail(std::string("can't write corpus file '") + path + "'");
+
+    Header h{};
+    std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = VERSION;
+    h.encoding = std::uint32_t(enc);
+    h.samples = size();
+    h.strokes = stroke_points.size() - 1;
+    h.points = x.size();
+    h.label_bytes = labels.size();
+    h.scale = 1;
+
+    // Quantize relative to the lowest coordinates, exactly if they are integers in range
+    std::vector<std::int16_t> qx, qy;
+    if (enc == corpus::encoding::int16 && !x.empty()) {
+        const auto [xmin, xmax] = std::minmax_element(x.begin(), x.end());
+        const auto [ymin, ymax] = std::minmax_element(y.begin(), y.end());
+        h.origin_x = *xmin;
+        h.origin_y = *ymin;
+        const float range = std::max(*xmax - *xmin, *ymax - *ymin);
+        const auto integral = [](float v) { return v == std::floor(v); };
+        if (range > 65535 || !std::all_of(x.begin(), x.end(), integral) || !std::all_of(y.begin(), y.end(), integral))
+            h.scale = range > 0 ? range / 65535 : 1;
+
+        const auto quantize = [&](float v, float origin) {
+            const long q = std::lround((v - origin) / h.scale) - 32768;
+            return std::int16_t(std::clamp<long>(q, INT16_MIN, INT16_MAX));
+        };
+        for (std::size_t i = 0; i < x.size(); i++) {
+            qx.push_back(quantize(x[i], h.origin_x));
+            qy.push_back(quantize(y[i], h.origin_y));
+        }
+    }
+
+    const auto section = [&](const void* p, std::size_t size) {
+        static const char zeros[8] = {};
+        fd.write(static_cast<const char*>(p), size);
+        fd.write(zeros, align8(size) - size);
+    };
+    section(&h, sizeof(h));
+    section(sample_strokes.data(), sample_strokes.size() * sizeof(std::uint64_t));
+    section(stroke_points.data(), stroke_points.size() * sizeof(std::uint64_t));
+    section(label_offsets.data(), label_offsets.size() * sizeof(std::uint64_t));
+    section(labels.data(), labels.size());
+    if (enc == corpus::encoding::int16) {
+        section(qx.data(), qx.size() * sizeof(std::int16_t));
+        section(qy.data(), qy.size() * sizeof(std::int16_t));
+    } else {
+        section(x.data(), x.size() * sizeof(float));
+        section(y.data(), y.size() * sizeof(float));
+    }
+
+    if (!fd)
+        fail(std::string("error writing corpus file '") + path + "'");
+}
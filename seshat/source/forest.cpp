@@ -0,0 +1,58 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <seshat/forest.hpp>
+
+using namespace seshat;
+
+static void render(const forest& f, std::uint32_t id, std::string& out)
+{
+    const auto& n = f.nodes[id];
+    for (int k = 0; k < 2; k++) {
+        out += f.strings[n.text[k]];
+        if (n.child[k] >= 0)
+            render(f, n.child[k], out);
+    }
+    out += f.strings[n.text[2]];
+}
+
+std::size_t forest::size() const
+{
+    return roots.size();
+}
+
+void forest::clear()
+{
+    strings.assign(1, {});
+    nodes.clear();
+    roots.clear();
+    scores.clear();
+}
+
+std::string forest::latex(std::size_t i) const
+{
+    std::string out;
+    latex(i, out);
+    return out;
+}
+
+void forest::latex(std::size_t i, std::string& out) const
+{
+    out.clear();
+    render(*this, roots[i], out);
+}
@@ -18,6 +18,7 @@
 
 #include <algorithm>
 #include <cfloat>
+#include <climits>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
@@ -39,7 +40,7 @@ using namespace seshat;
 
 void error(const char* msg)
 {
-    static char tmp[1024];
+    thread_local char tmp[1024];
     sprintf(tmp, "Grammar err[%s]\n", msg);
     fputs(tmp, stderr);
     throw std::runtime_error(tmp);
@@ -47,7 +48,7 @@ void error(const char* msg)
 
 void error(const char* msg, std::string_view str)
 {
-    static char tmp[1024], tmp2[1024];
+    thread_local char tmp[1024], tmp2[1024];
     sprintf(tmp, "Grammar err[%s]\n", msg);
     sprintf(tmp2, tmp, (int)str.size(), str.data());
     fputs(tmp2, stderr);
@@ -79,6 +80,126 @@ Grammar::Grammar(const fs::path& path, SymRec* sr)
         esInit[it] = true;
 }
 
+bool Grammar::composesClase(ProductionB& pd, const std::vector<bool>& clases)
+{
+    if (pd.check_out())
+        return true;
+
+    const int clase = sym_rec->keyClase(pd.get_outstr());
+    return clase < 0 || clases[clase];
+}
+
+std::vector<bool> Grammar::liveNoTerminals(const std::vector<bool>& clases)
+{
+    const int NT = noTerminales.size();
+    const std::vector<std::unique_ptr<ProductionB>>* binary[] = {
+        &prodsH, &prodsSup, &prodsSub, &prodsV, &prodsVe, &prodsIns, &prodsMrt, &prodsSSE
+    };
+
+    // Bottom-up: non-terminals that derive some string of allowed terminals
+    std::vector<bool> productive(NT, false);
+    for (const auto& pt : prodTerms) {
+        for (int k = 0; k < pt->N; k++) {
+            if (clases[k] && pt->getClase(k) && pt->getPrior(k) > -FLT_MAX) {
+                productive[pt->getNoTerm()] = true;
+                break;
+            }
+        }
+    }
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (const auto prods : binary) {
+            for (const auto& pd : *prods) {
+                if (productive[pd->S] || pd->prior == -FLT_MAX)
+                    continue;
+                if (productive[pd->A] && productive[pd->B] && composesClase(*pd, clases)) {
+                    productive[pd->S] = true;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // Top-down: productive non-terminals reachable from a start symbol
+    std::vector<bool> live(NT, false);
+    std::vector<int> pending;
+    for (const auto it : initsyms) {
+        if (productive[it] && !live[it]) {
+            live[it] = true;
+            pending.push_back(it);
+        }
+    }
+
+    while (!pending.empty()) {
+        const int nt = pending.back();
+        pending.pop_back();
+
+        for (const auto prods : binary) {
+            for (const auto& pd : *prods) {
+                if (pd->S != nt || pd->prior == -FLT_MAX)
+                    continue;
+                if (!productive[pd->A] || !productive[pd->B] || !composesClase(*pd, clases))
+                    continue;
+
+                for (const int child : { pd->A, pd->B }) {
+                    if (!live[child]) {
+                        live[child] = true;
+                        pending.push_back(child);
+                    }
+                }
+            }
+        }
+    }
+
+    return live;
+}
+
+std::vector<int> Grammar::minStrokesLeft(std::span<ProductionB* const> prods, std::span<ProductionT* const> terms)
+{
+    const int NT = noTerminales.size();
+    const auto add = [](int a, int b) { return a == INT_MAX || b == INT_MAX ? INT_MAX : a + b; };
+
+    // Fewest strokes a non-terminal derives: a symbol takes at least one stroke
+    std::vector<int> least(NT, INT_MAX);
+    for (const auto pt : terms)
+        least[pt->getNoTerm()] = 1;
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (const auto pd : prods) {
+            const int n = add(least[pd->A], least[pd->B]);
+            if (n < least[pd->S]) {
+                least[pd->S] = n;
+                changed = true;
+            }
+        }
+    }
+
+    // A start symbol needs nothing else, the children of S -> A B need what S needs and the other one
+    std::vector<int> left(NT, INT_MAX);
+    for (const auto it : initsyms)
+        left[it] = 0;
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (const auto pd : prods) {
+            const int na = add(left[pd->S], least[pd->B]);
+            const int nb = add(left[pd->S], least[pd->A]);
+            if (na < left[pd->A]) {
+                left[pd->A] = na;
+                changed = true;
+            }
+            if (nb < left[pd->B]) {
+                left[pd->B] = nb;
+                changed = true;
+            }
+        }
+    }
+
+    return left;
+}
+
 void Grammar::addInitSym(const std::string& str)
 {
     const auto it = noTerminales.find(str);
@@ -21,32 +21,44 @@
 
 using namespace seshat;
 
-InternalHypothesis::InternalHypothesis(int c, double p, CellCYK* cd, int nt)
+InternalHypothesis::InternalHypothesis(int c, double p, CellCYK* cd, int nt, Derivation* d)
 {
-    clase = c;
     pr = p;
-    hi = nullptr;
-    hd = nullptr;
-    prod = nullptr;
-    prod_sse = nullptr;
-    pt = nullptr;
+    clase = c;
     lcen = 0;
     rcen = 0;
-    parent = cd;
     ntid = nt;
+    parent = cd;
+    der = d;
+
+    // Terminal symbols span the region of their cell
+    lx = rx = cd ? cd->x : 0;
+    ls = rs = cd ? cd->s : 0;
 }
 
 void InternalHypothesis::copy(const InternalHypothesis& H)
 {
-    clase = H.clase;
-    pr = H.pr;
-    hi = H.hi;
-    hd = H.hd;
-    prod = H.prod;
-    prod_sse = H.prod_sse;
-    pt = H.pt;
-    lcen = H.lcen;
-    rcen = H.rcen;
-    parent = H.parent;
-    ntid = H.ntid;
+    *this = H;
+}
+
+// Leftmost and rightmost terminals of a derivation combining the subtrees A and B
+void InternalHypothesis::setTermExtent(const InternalHypothesis& A, const InternalHypothesis& B)
+{
+    const auto& lm = A.lx < B.lx ? A : B;
+    lx = lm.lx;
+    ls = lm.ls;
+
+    const auto& rm = A.rs > B.rs ? A : B;
+    rx = rm.rx;
+    rs = rm.rs;
+}
+
+void Derivation::splice(Derivation* d)
+{
+    Derivation* last = d;
+    while (last->alt)
+        last = last->alt;
+
+    last->alt = alt;
+    alt = d;
 }
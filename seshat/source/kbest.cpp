@@ -0,0 +1,137 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cellcyk.hpp>
+#include <kbest.hpp>
+
+using namespace seshat;
+
+// Add candidate (e, i, j) to the heap of node, if its children exist and it's not there yet
+void KBest::push(Node& node, Derivation* e, int i, int j)
+{
+    if (!node.seen.emplace(e, i, j).second)
+        return;
+
+    double pr = e->pr;
+    if (e->hi) {
+        const InternalHypothesis* hi = get(e->hi, i);
+        if (!hi)
+            return;
+        pr += hi->pr - e->hi->pr;
+    }
+    if (e->hd) {
+        const InternalHypothesis* hd = get(e->hd, j);
+        if (!hd)
+            return;
+        pr += hd->pr - e->hd->pr;
+    }
+
+    node.heap.push_back({ pr, e, i, j });
+    std::push_heap(node.heap.begin(), node.heap.end());
+}
+
+const InternalHypothesis* KBest::get(const InternalHypothesis* H, int k)
+{
+    if (k == 0)
+        return H;
+
+    // Node references stay valid while the recursion adds more nodes
+    auto [it, fresh] = nodes.try_emplace(H);
+    Node& node = it->second;
+
+    if (fresh) {
+        // H holds the best derivation, the next ones are its neighbours or another derivation
+        node.best.push_back(H);
+        node.seen.emplace(H->der, 0, 0);
+        if (H->der->hi)
+            push(node, H->der, 1, 0);
+        if (H->der->hd)
+            push(node, H->der, 0, 1);
+        for (Derivation* e = H->der->alt; e; e = e->alt)
+            push(node, e, 0, 0);
+    }
+
+    while ((int)node.best.size() <= k && !node.heap.empty()) {
+        std::pop_heap(node.heap.begin(), node.heap.end());
+        const Candidate c = node.heap.back();
+        node.heap.pop_back();
+
+        Derivation& d = ders.emplace_back(*c.e);
+        d.hi = c.e->hi ? get(c.e->hi, c.i) : nullptr;
+        d.hd = c.e->hd ? get(c.e->hd, c.j) : nullptr;
+        d.pr = c.pr;
+        d.alt = nullptr;
+
+        InternalHypothesis& h = hyps.emplace_back(*H);
+        h.pr = c.pr;
+        h.clase = c.e->clase;
+        h.der = &d;
+        node.best.push_back(&h);
+
+        if (c.e->hi)
+            push(node, c.e, c.i + 1, c.j);
+        if (c.e->hd)
+            push(node, c.e, c.i, c.j + 1);
+    }
+
+    return k < (int)node.best.size() ? node.best[k] : nullptr;
+}
+
+std::vector<const InternalHypothesis*> KBest::best(const std::vector<const InternalHypothesis*>& roots, int k)
+{
+    // Next derivation of each root, ordered by the number of strokes covered and then by probability
+    struct Root {
+        int comps;
+        double pr;
+        int idx, rank;
+
+        bool operator<(const Root& R) const
+        {
+            if (comps != R.comps)
+                return comps < R.comps;
+            if (pr != R.pr)
+                return pr < R.pr;
+            return idx > R.idx;
+        }
+    };
+
+    std::vector<Root> heap;
+    for (int i = 0; i < (int)roots.size(); i++) {
+        const CellCYK* c = roots[i]->parent;
+        heap.push_back({ (int)std::count(c->ccc.get(), c->ccc.get() + c->nc, true), roots[i]->pr, i, 0 });
+    }
+    std::make_heap(heap.begin(), heap.end());
+
+    std::vector<const InternalHypothesis*> out;
+    while ((int)out.size() < k && !heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end());
+        Root r = heap.back();
+        heap.pop_back();
+
+        out.push_back(get(roots[r.idx], r.rank));
+
+        if (const InternalHypothesis* next = get(roots[r.idx], ++r.rank)) {
+            r.pr = next->pr;
+            heap.push_back(r);
+            std::push_heap(heap.begin(), heap.end());
+        }
+    }
+
+    return out;
+}
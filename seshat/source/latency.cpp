@@ -0,0 +1,75 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <cmath>
+#include <latency.hpp>
+
+namespace seshat {
+
+void LatencyControl::setTarget(std::chrono::nanoseconds t)
+{
+    target = t;
+    rates = {};
+}
+
+bool LatencyControl::enabled() const
+{
+    return target.count() > 0;
+}
+
+parse_effort LatencyControl::choose(const std::array<double, 3>& work)
+{
+    // Parses after which a level ruled out is tried again
+    constexpr int reprobe = 32;
+
+    // A level not measured yet is tried when the more thorough ones are too slow
+    for (int l = 0; l < 2; l++) {
+        Rate& r = rates[l];
+        // Rates vary from parse to parse, expect a slow one rather than the average
+        const double expected = (r.mean + 2 * r.dev) * work[l];
+        if (expected <= target.count()) {
+            r.skipped = 0;
+            return static_cast<parse_effort>(l);
+        }
+        // The rate of a level only changes when it runs, so try it again now and then in case
+        // parses became faster, as long as it's not expected to take much longer than the target
+        if (++r.skipped >= reprobe && expected <= 2 * target.count()) {
+            r.skipped = 0;
+            return static_cast<parse_effort>(l);
+        }
+    }
+    return parse_effort::minimal;
+}
+
+void LatencyControl::measure(parse_effort e, double work, std::chrono::nanoseconds elapsed)
+{
+    if (work <= 0)
+        return;
+
+    // Moving averages, recent parses weigh more
+    Rate& r = rates[static_cast<int>(e)];
+    const double observed = elapsed.count() / work;
+    if (r.mean > 0) {
+        r.dev += 0.25 * (std::abs(observed - r.mean) - r.dev);
+        r.mean += 0.125 * (observed - r.mean);
+    } else {
+        r.mean = observed;
+        r.dev = observed / 2;
+    }
+}
+
+}
@@ -16,11 +16,15 @@
     along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <logspace.hpp>
 
 using namespace seshat;
 
-LogSpace::LogSpace(CellCYK* c, int nr, int dx, int dy)
+LogSpace::LogSpace(CellCYK* c, int nr, int dx, int dy, const search_windows& w)
+    : win{ w }
 {
     // List length
     N = nr;
@@ -40,95 +44,127 @@ LogSpace::LogSpace(CellCYK* c, int nr, int dx, int dy)
     quicksort(data.get(), 0, N - 1);
 }
 
-void LogSpace::getH(CellCYK* c, std::vector<CellCYK*>& set)
+int LogSpace::rx(float f) const
 {
-    int sx, sy, ss, st;
+    return (int)(RX * f);
+}
 
-    // Set the region to search
-    sx = std::max(c->x + 1, c->s - (int)(RX * 2)); // (sx,sy)------
-    ss = c->s + RX * 8; //  ------------
-    sy = c->y - RY; //  ------------
-    st = c->t + RY; //  ------(ss,st)
+int LogSpace::ry(float f) const
+{
+    return (int)(RY * f);
+}
 
-    // Retrieve the regions
-    bsearchHBP(sx, sy, ss, st, set, c);
+// Right region
+LogSpace::Window LogSpace::windowH(const CellCYK* c) const
+{
+    return {
+        std::max(c->x + 1, c->s - rx(win.back)), // (sx,sy)------
+        c->y - ry(win.rise), //  ------------
+        c->s + rx(win.right), //  ------------
+        c->t + ry(win.rise) //  ------(ss,st)
+    };
 }
 
 // Below region
-void LogSpace::getV(CellCYK* c, std::vector<CellCYK*>& set)
+LogSpace::Window LogSpace::windowV(const CellCYK* c) const
+{
+    return { c->x - rx(win.side), std::max(c->t - ry(win.overlap), c->y + 1), c->s + rx(win.side), c->t + ry(win.below) };
+}
+
+// Above region
+LogSpace::Window LogSpace::windowU(const CellCYK* c) const
+{
+    return { c->x - rx(win.side), c->y - ry(win.below), c->s + rx(win.side), std::min(c->y + ry(win.overlap), c->t - 1) };
+}
+
+// Inside region (sqrt)
+LogSpace::Window LogSpace::windowI(const CellCYK* c) const
+{
+    return { c->x + 1, c->y + 1, c->s + rx(win.inside_right), c->t + ry(win.inside_below) };
+}
+
+// Mroot region (n-th sqrt)
+LogSpace::Window LogSpace::windowM(const CellCYK* c) const
+{
+    return { c->x - rx(win.index_side), c->y - ry(win.index_above), std::min(c->x + rx(win.index_side), c->s), std::min(c->y + ry(win.index_below), c->t) };
+}
+
+// SubSupScript regions
+LogSpace::Window LogSpace::windowS(const CellCYK* c) const
 {
-    int sx, sy, ss, st;
+    return { c->x - 1, c->y - RY, c->x + 1, c->t + RY };
+}
 
-    // Set the region to search
-    sx = c->x - 2 * RX;
-    ss = c->s + 2 * RX;
-    sy = std::max(c->t - RY, c->y + 1);
-    st = c->t + RY * 3;
+void LogSpace::getH(CellCYK* c, std::vector<CellCYK*>& set)
+{
+    const Window w = windowH(c);
+    bsearchHBP(w.sx, w.sy, w.ss, w.st, set, c);
+}
 
-    // Retrieve the regions
-    bsearchStv(sx, sy, ss, st, set, false, c);
+void LogSpace::getV(CellCYK* c, std::vector<CellCYK*>& set)
+{
+    const Window w = windowV(c);
+    bsearchStv(w.sx, w.sy, w.ss, w.st, set, false, c);
 }
 
-// Above region. Although only Below is really considered this is necessary to
+// Although only Below is really considered this is necessary to
 // solve the problem of the case | aaa|
 //                               |bbbb|
 // such that "a" would never find "b" because its 'sx' would start before "b.x"
 void LogSpace::getU(CellCYK* c, std::vector<CellCYK*>& set)
 {
-    int sx, sy, ss, st;
-
-    // Set the region to search
-    sx = c->x - 2 * RX;
-    ss = c->s + 2 * RX;
-    sy = c->y - RY * 3;
-    st = std::min(c->y + RY, c->t - 1);
-
-    // Retrieve the regions
-    bsearchStv(sx, sy, ss, st, set, true, c);
+    const Window w = windowU(c);
+    bsearchStv(w.sx, w.sy, w.ss, w.st, set, true, c);
 }
 
-// Inside region (sqrt)
 void LogSpace::getI(CellCYK* c, std::vector<CellCYK*>& set)
 {
-    int sx, sy, ss, st;
-
-    // Set the region to search
-    sx = c->x + 1; // (sx,sy)------
-    ss = c->s + RX; //  ------------
-    sy = c->y + 1; //  ------------
-    st = c->t + RY; //  ------(ss,st)
-
-    // Retrieve the regions
-    bsearch(sx, sy, ss, st, set);
+    const Window w = windowI(c);
+    bsearch(w.sx, w.sy, w.ss, w.st, set);
 }
 
-// Mroot region (n-th sqrt)
 void LogSpace::getM(CellCYK* c, std::vector<CellCYK*>& set)
 {
-    int sx, sy, ss, st;
+    const Window w = windowM(c);
+    bsearch(w.sx, w.sy, w.ss, w.st, set);
+}
 
-    // Set the region to search
-    sx = c->x - 2 * RX; // (sx,sy)------
-    ss = std::min(c->x + 2 * RX, c->s); //  ------------
-    sy = c->y - RY; //  ------------
-    st = std::min(c->y + 2 * RY, c->t); //  ------(ss,st)
+void LogSpace::getS(CellCYK* c, std::vector<CellCYK*>& set)
+{
+    const Window w = windowS(c);
+    bsearch(w.sx, w.sy, w.ss, w.st, set);
+}
 
-    // Retrieve the regions
-    bsearch(sx, sy, ss, st, set);
+// Whether region d lies in the search window of c, as the queries above test it but
+// without narrowing the window to the closest regions found
+bool LogSpace::inH(const CellCYK* c, const CellCYK* d) const
+{
+    const Window w = windowH(c);
+    return d->x >= w.sx && d->x <= w.ss && d->y <= w.st && d->t >= w.sy;
 }
 
-// SubSupScript regions
-void LogSpace::getS(CellCYK* c, std::vector<CellCYK*>& set)
+bool LogSpace::inV(const CellCYK* c, const CellCYK* d) const
+{
+    const Window w = windowV(c);
+    return d->x >= w.sx && d->x <= w.ss && d->y <= w.st && d->y >= w.sy && d->s <= w.ss;
+}
+
+bool LogSpace::inU(const CellCYK* c, const CellCYK* d) const
 {
-    int sx, sy, ss, st;
+    const Window w = windowU(c);
+    return d->x >= w.sx && d->x <= w.ss && d->t <= w.st && d->t >= w.sy && d->s <= w.ss;
+}
 
-    // Set the region to search
-    sx = c->x - 1; // (sx,sy)------
-    ss = c->x + 1; //  ------------
-    sy = c->y - RY; //  ------------
-    st = c->t + RY; //  ------(ss,st)
+bool LogSpace::inI(const CellCYK* c, const CellCYK* d) const
+{
+    const Window w = windowI(c);
+    return d->x >= w.sx && d->x <= w.ss && d->y <= w.st && d->t >= w.sy;
+}
 
-    bsearch(sx, sy, ss, st, set);
+bool LogSpace::inM(const CellCYK* c, const CellCYK* d) const
+{
+    const Window w = windowM(c);
+    return d->x >= w.sx && d->x <= w.ss && d->y <= w.st && d->t >= w.sy;
 }
 
 void LogSpace::bsearch(int sx, int sy, int ss, int st, std::vector<CellCYK*>& set)
@@ -246,3 +282,58 @@ int LogSpace::partition(CellCYK** vec, int ini, int fin)
 
     return j;
 }
+
+// Same order as the fields of search_windows
+static constexpr float search_windows::*window_params[] = {
+    &search_windows::right, &search_windows::back, &search_windows::rise,
+    &search_windows::below, &search_windows::overlap, &search_windows::side,
+    &search_windows::inside_right, &search_windows::inside_below,
+    &search_windows::index_side, &search_windows::index_above, &search_windows::index_below
+};
+enum { Right, Back, Rise, Below, Overlap, Side, InsideRight, InsideBelow, IndexSide, IndexAbove, IndexBelow };
+
+void WindowCalibration::add(char tipo, const CellCYK* a, const CellCYK* b, int RX, int RY)
+{
+    const float fx = RX, fy = RY;
+    const auto need = [&](int param, float n) { needs[param].push_back(std::max(0.0f, n)); };
+
+    switch (tipo) {
+    case 'H':
+    case 'P':
+    case 'B':
+        need(Right, (b->x - a->s) / fx);
+        need(Back, (a->s - b->x) / fx);
+        need(Rise, std::max(a->y - b->t, b->y - a->t) / fy);
+        break;
+    case 'V':
+    case 'e':
+        // Found either looking down from a or looking up from b
+        need(Below, (b->y - a->t) / fy);
+        need(Overlap, (a->t - b->y) / fy);
+        need(Side, std::min(std::max(a->x - b->x, b->s - a->s), std::max(b->x - a->x, a->s - b->s)) / fx);
+        break;
+    case 'I':
+        need(InsideRight, (b->x - a->s) / fx);
+        need(InsideBelow, (b->y - a->t) / fy);
+        break;
+    case 'M':
+        need(IndexSide, abs(b->x - a->x) / fx);
+        need(IndexAbove, (a->y - b->t) / fy);
+        need(IndexBelow, (b->y - a->y) / fy);
+        break;
+    }
+}
+
+search_windows WindowCalibration::windows(search_windows w, float quantile) const
+{
+    for (std::size_t k = 0; k < needs.size(); k++) {
+        if (needs[k].empty())
+            continue;
+
+        std::vector<float> sorted = needs[k];
+        std::sort(sorted.begin(), sorted.end());
+        const std::size_t idx = std::clamp<long>(std::ceil(quantile * sorted.size()) - 1, 0, sorted.size() - 1);
+        w.*window_params[k] = sorted[idx];
+    }
+    return w;
+}
@@ -16,10 +16,12 @@
     along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <agenda.hpp>
 #include <cellcyk.hpp>
 #include <gmm.hpp>
 #include <grammar.hpp>
 #include <internal_hypothesis.hpp>
+#include <kbest.hpp>
 #include <logspace.hpp>
 #include <meparser.hpp>
 
@@ -28,11 +30,20 @@ using namespace seshat;
 // Symbol classifier N-Best
 #define NB 10
 
+// Search settings of the reduced and minimal effort levels, full effort uses the configured ones
+static const struct {
+    int nbest, strokes;
+    float min_prob;
+} lowerEffort[] = { { 5, 3, 0.05f }, { 2, 2, 0.2f } };
+
 meParser::meParser(const fs::path& conf)
 {
     // Read configuration file
     clusterF = -1;
     segmentsTH = -1;
+    segMaxSize = 0.0;
+    segMinProb = 0.0;
+    segMinScore = -FLT_MAX;
     max_strokes = -1;
     ptfactor = -1;
     pbfactor = -1;
@@ -41,6 +52,9 @@ meParser::meParser(const fs::path& conf)
     gfactor = -1;
     rfactor = -1;
     maxHypothesis = 1;
+    bestFirst = false;
+    bestFirstItems = 0;
+    effort = parse_effort::full;
     std::string path;
 
     {
@@ -67,6 +81,12 @@ meParser::meParser(const fs::path& conf)
                 fconfig >> clusterF >> std::ws;
             } else if (auxstr == "SegmentsTH") {
                 fconfig >> segmentsTH >> std::ws;
+            } else if (auxstr == "SegmentMaxSize") {
+                fconfig >> segMaxSize >> std::ws;
+            } else if (auxstr == "SegmentMinProb") {
+                fconfig >> segMinProb >> std::ws;
+            } else if (auxstr == "SegmentMinScore") {
+                fconfig >> segMinScore >> std::ws;
             } else if (auxstr == "ProductionTSF") {
                 fconfig >> ptfactor >> std::ws;
             } else if (auxstr == "ProductionBSF") {
@@ -109,6 +129,16 @@ meParser::meParser(const fs::path& conf)
         throw std::runtime_error("Error: Wrong SegmentsTH value in config file");
     }
 
+    if (segMaxSize < 0) {
+        std::cerr << "Error: Wrong SegmentMaxSize value in config file '" << conf << "'\n";
+        throw std::runtime_error("Error: Wrong SegmentMaxSize value in config file");
+    }
+
+    if (segMinProb < 0 || segMinProb >= 1) {
+        std::cerr << "Error: Wrong SegmentMinProb value in config file '" << conf << "'\n";
+        throw std::runtime_error("Error: Wrong SegmentMinProb value in config file");
+    }
+
     if (InsPen <= 0) {
         std::cerr << "Error: Wrong InsPenalty value in config file '" << conf << "'\n";
         throw std::runtime_error("Error: Wrong InsPenalty value in config file");
@@ -132,6 +162,60 @@ meParser::meParser(const fs::path& conf)
 
     // Load grammar
     G = std::make_unique<Grammar>(conf.parent_path() / path, sym_rec.get());
+
+    // Every symbol class is allowed by default
+    restrictGrammar(std::vector<bool>(sym_rec->getNClases(), true));
+}
+
+// Keep the productions whose non-terminals can still derive a start symbol
+void meParser::restrictGrammar(const std::vector<bool>& clases)
+{
+    const auto live = G->liveNoTerminals(clases);
+
+    const auto filter = [&](std::vector<ProductionB*>& into, const std::vector<std::unique_ptr<ProductionB>>& prods) {
+        into.clear();
+        for (const auto& pd : prods) {
+            if (pd->prior == -FLT_MAX)
+                continue;
+            if (live[pd->S] && live[pd->A] && live[pd->B] && G->composesClase(*pd, clases))
+                into.push_back(pd.get());
+        }
+    };
+
+    filter(actH, G->prodsH);
+    filter(actSup, G->prodsSup);
+    filter(actSub, G->prodsSub);
+    filter(actV, G->prodsV);
+    filter(actVe, G->prodsVe);
+    filter(actIns, G->prodsIns);
+    filter(actMrt, G->prodsMrt);
+    filter(actSSE, G->prodsSSE);
+
+    actTerms.clear();
+    for (const auto& pt : G->prodTerms) {
+        if (live[pt->getNoTerm()])
+            actTerms.push_back(pt.get());
+    }
+
+    std::vector<ProductionB*> prods;
+    for (const auto act : { &actH, &actSup, &actSub, &actV, &actVe, &actIns, &actMrt, &actSSE })
+        prods.insert(prods.end(), act->begin(), act->end());
+    minLeft = G->minStrokesLeft(prods, actTerms);
+
+    // Upper bound of the prior and duration terms of a terminal hypothesis, used
+    // to discard segmentations that can't reach the score threshold
+    maxTermScore.assign(max_strokes + 1, -FLT_MAX);
+    for (const auto pt : actTerms) {
+        for (int k = 0; k < pt->N; k++) {
+            if (!clases[k] || !pt->getClase(k) || pt->getPrior(k) == -FLT_MAX)
+                continue;
+
+            for (int size = 1; size <= max_strokes; size++) {
+                const float score = ptfactor * pt->getPrior(k) + dfactor * log(duration->prob(k, size));
+                maxTermScore[size] = std::max(maxTermScore[size], score);
+            }
+        }
+    }
 }
 
 void meParser::loadSymRec(const fs::path& config)
@@ -169,49 +253,68 @@ void meParser::loadSymRec(const fs::path& config)
     }
 
     // Load symbol recognizer
-    sym_rec = std::make_unique<SymRec>(config);
+    sym_rec = std::make_unique<SymRec>(config, stats);
 
     // Load duration and segmentation model
     duration.emplace(config.parent_path() / dur_path, max_strokes, sym_rec.get());
     segmentation.emplace(config.parent_path() / seg_path);
 }
 
+// Store a derivation record, valid until the next parse
+Derivation* meParser::derive(const Derivation& d)
+{
+    return &derivations.emplace_back(d);
+}
+
 // CYK table initialization with the terminal symbols
 void meParser::initCYKterms(Samples& M, TableCYK& tcyk, int N, int K)
 {
     int clase[NB];
     float pr[NB];
 
-    for (int i = 0; i < M.nStrokes(); i++) {
+    for (int i = 0; i < M.nStrokes() && !stopped(); i++) {
         int cmy, asc, des;
-        cmy = sym_rec->clasificar(M, i, NB, clase, pr, asc, des);
+        const int stk[1] = { i };
+        cmy = classify(M, stk, clase, pr, asc, des);
 
         auto cd = std::make_unique<CellCYK>(G->noTerminales.size(), N);
 
         M.setRegion(*cd, i);
 
         bool insertar = false;
-        for (const auto& prod : G->prodTerms) {
-            for (int k = 0; k < NB; k++) {
+        for (const auto prod : actTerms) {
+            if (dead(prod->getNoTerm(), 1, N)) {
+                ++stats.terminals_dead;
+                continue;
+            }
+            for (int k = 0; k < nbest; k++) {
                 const auto clase_k = clase[k];
-                const auto gotClase = prod->getClase(clase_k);
+                if (!(pr[k] > 0.0 && prod->getClase(clase_k)))
+                    continue;
                 const auto gotPrior = prod->getPrior(clase_k);
                 const auto gotNoTerm = prod->getNoTerm();
-                if (!(pr[k] > 0.0 && gotClase && gotPrior > -FLT_MAX))
+                if (!(gotPrior > -FLT_MAX))
                     continue;
 
                 const float prob = log(InsPen) + ptfactor * gotPrior + qfactor * log(pr[k]) + dfactor * log(duration->prob(clase_k, 1));
 
-                if (cd->noterm[gotNoTerm]) {
-                    if (cd->noterm[gotNoTerm]->pr > prob + gotPrior)
-                        continue;
+                // Less likely classes are kept as alternative derivations when asked for several hypotheses.
+                // The k-best extraction takes the hypothesis of the cell as its most likely derivation,
+                // so then the cell must keep the most likely class rather than the prior-weighted one
+                InternalHypothesis* old = cd->noterm[gotNoTerm];
+                if (old && old->pr > prob + (tcyk.keepsAlternatives() ? 0.0f : gotPrior)) {
+                    if (tcyk.keepsAlternatives())
+                        old->der->splice(derive({ .pt = prod, .pr = prob, .clase = clase_k }));
+                    continue;
                 }
+                Derivation* prev = old && tcyk.keepsAlternatives() ? old->der : nullptr;
 
                 insertar = true;
 
                 // Create new symbol
-                cd->noterm[gotNoTerm] = std::make_unique<InternalHypothesis>(clase_k, prob, cd.get(), gotNoTerm);
-                cd->noterm[gotNoTerm]->pt = prod.get();
+                InternalHypothesis* H = cd->noterm.set(gotNoTerm, InternalHypothesis(clase_k, prob, cd.get(), gotNoTerm, derive({ .pt = prod, .pr = prob, .clase = clase_k })));
+                if (prev)
+                    H->der->splice(prev);
 
                 // Compute the vertical centroid according to the type of symbol
                 int cen;
@@ -226,129 +329,233 @@ void meParser::initCYKterms(Samples& M, TableCYK& tcyk, int N, int K)
                     cen = (cd->t + cd->y) * 0.5; // Middle point
 
                 // Vertical center
-                cd->noterm[gotNoTerm]->lcen = cen;
-                cd->noterm[gotNoTerm]->rcen = cen;
+                H->lcen = cen;
+                H->rcen = cen;
             }
         }
 
         if (insertar) {
             // Add to parsing table (size=1)
-            tcyk.add(1, cd.release(), -1, G->esInit.get());
+            tcyk.add(1, cd.release(), -1);
         }
     }
 }
 
+// Classify a set of strokes (sorted), reusing the result of a previous parse if there is one
+int meParser::classify(Samples& M, std::span<const int> stks, int* clase, float* pr, int& asc, int& des)
+{
+    if (cache) {
+        if (const auto C = cache->find(stks)) {
+            ++stats.classifications_cached;
+            std::copy(C->clase.begin(), C->clase.end(), clase);
+            std::copy(C->pr.begin(), C->pr.end(), pr);
+            asc = C->asc;
+            des = C->des;
+            return C->cmy;
+        }
+    }
+
+    const int cmy = sym_rec->clasificar(M, stks, NB, clase, pr, asc, des);
+    if (cache)
+        cache->store(stks, { { clase, clase + NB }, { pr, pr + NB }, cmy, asc, des });
+    return cmy;
+}
+
+// Proximity graph: strokes closer than the distance threshold are linked
+void meParser::proximityGraph(Samples& M, int N)
+{
+    close_strokes.resize(N);
+    for (int i = 0; i < N; i++) {
+        close_strokes[i].clear();
+        for (int j = 0; j < N; j++)
+            if (j != i && M.getDist(i, j) < segmentsTH)
+                close_strokes[i].push_back(j);
+    }
+}
+
+// Pick the effort of the parse and apply its settings. Returns the estimated work
+double meParser::chooseEffort(int N)
+{
+    // Classifying the symbol hypotheses takes most of the time. Besides every stroke, each
+    // pair of close strokes and each stroke close to two others may be one
+    double pairs = 0, triples = 0;
+    for (const auto& close : close_strokes) {
+        const double d = close.size();
+        pairs += d / 2;
+        triples += d * (d - 1) / 2;
+    }
+    const auto work = [&](int strokes) {
+        return N + (strokes >= 2 ? pairs : 0) + (strokes >= 3 ? triples : 0);
+    };
+    const std::array<double, 3> levels = {
+        work(max_strokes),
+        work(std::min(max_strokes, lowerEffort[0].strokes)),
+        work(std::min(max_strokes, lowerEffort[1].strokes)),
+    };
+
+    effort = latency.enabled() ? latency.choose(levels) : parse_effort::full;
+    if (effort == parse_effort::full) {
+        nbest = NB;
+        segStrokes = max_strokes;
+        segProb = segMinProb;
+    } else {
+        const auto& e = lowerEffort[static_cast<int>(effort) - 1];
+        nbest = e.nbest;
+        segStrokes = std::min(max_strokes, e.strokes);
+        segProb = std::max(segMinProb, e.min_prob);
+        if (effort == parse_effort::reduced)
+            ++stats.parses_reduced;
+        else
+            ++stats.parses_minimal;
+    }
+    return levels[static_cast<int>(effort)];
+}
+
 void meParser::combineStrokes(Samples& M, TableCYK& tcyk, int N)
 {
     if (N <= 1)
         return;
 
-    int asc, cmy, des;
-    int clase[NB];
-    float pr[NB];
-    int ntested = 0;
+    // Every connected subset of strokes is generated once, from its highest stroke id
+    std::vector<int> extension;
+    for (int stkc1 = 1; stkc1 < N && !stopped(); stkc1++) {
+        extension.clear();
+        for (const int i : close_strokes[stkc1])
+            if (i < stkc1)
+                extension.push_back(i);
 
-    // Set distance threshold
-    float distance_th = segmentsTH;
-    close_list.clear();
-    stks_list.clear();
-    stkvec.clear();
-
-    // For every single stroke
-    for (int stkc1 = 1; stkc1 < N; stkc1++) {
+        stks_list.assign(1, stkc1);
+        extendSegment(M, tcyk, N, stkc1, extension);
+    }
+}
 
-        CellCYK* c1 = new CellCYK(G->noTerminales.size(), N);
-        M.setRegion(*c1, stkc1);
+// ESU enumeration: grow the current subset (stks_list) with the strokes of the extension
+// set, which only receives neighbours that are not adjacent to the subset already
+void meParser::extendSegment(Samples& M, TableCYK& tcyk, int N, int anchor, std::vector<int> extension)
+{
+    const auto adjacent = [&](int i, int j) {
+        return M.getDist(i, j) < segmentsTH;
+    };
 
-        for (int size = 2; size <= std::min(max_strokes, N); size++) {
-            close_list.clear();
+    while (!extension.empty() && !stopped()) {
+        const int w = extension.back();
+        extension.pop_back();
 
-            // Add close and visible strokes to the closer list
-            if (size == 2) {
-                for (int i = 0; i < stkc1; i++) {
-                    if (M.getDist(stkc1, i) < distance_th) {
-                        close_list.push_back(i);
-                    }
-                }
-            } else
-                M.get_close_strokes(stkc1, close_list, distance_th);
-
-            // If there are not enough strokes to compose a hypothesis of "size", continue
-            if ((int)close_list.size() < size - 1)
+        std::vector<int> next = extension;
+        for (const int u : close_strokes[w]) {
+            if (u >= anchor || std::find(stks_list.begin(), stks_list.end(), u) != stks_list.end())
                 continue;
+            if (std::any_of(stks_list.begin(), stks_list.end(), [&](int v) { return adjacent(u, v); }))
+                continue;
+            next.push_back(u);
+        }
 
-            stkvec.clear();
-            stkvec.insert(stkvec.end(), close_list.begin(), close_list.end());
-            const int VS = stkvec.size();
+        // Supersets of an implausible segment are implausible too
+        stks_list.push_back(w);
+        if (testSegment(M, tcyk, N) && (int)stks_list.size() < segStrokes)
+            extendSegment(M, tcyk, N, anchor, std::move(next));
+        stks_list.pop_back();
+    }
+}
 
-            std::sort(stkvec.begin(), stkvec.end());
+// Classify the multi-stroke symbol hypothesis in stks_list and add it to the parsing table.
+// Returns false if the strokes are too spread to belong to the same symbol
+bool meParser::testSegment(Samples& M, TableCYK& tcyk, int N)
+{
+    int asc, cmy, des;
+    int clase[NB];
+    float pr[NB];
 
-            for (int i = size - 2; i < VS; i++) {
-                stks_list.clear();
-                // Add stkc1 and current stroke (ith)
-                stks_list.push_back(stkvec[i]);
-                stks_list.push_back(stkc1);
+    const int size = stks_list.size();
 
-                // Add strokes up to size
-                stks_list.insert(stks_list.end(), stkvec.begin() + (i - (size - 2)), stkvec.begin() + i);
+    // Sort list (stroke's order is important in online classification)
+    stkvec.assign(stks_list.begin(), stks_list.end());
+    std::sort(stkvec.begin(), stkvec.end());
 
-                // Sort list (stroke's order is important in online classification)
-                std::sort(stks_list.begin(), stks_list.end());
+    // Geometric plausibility, if enabled: the symbol can't be much larger than the reference symbol
+    int rx = INT_MAX, ry = INT_MAX, rs = INT_MIN, rt = INT_MIN;
+    for (const int i : stkvec) {
+        const auto& stk = M.getStroke(i);
+        rx = std::min(rx, stk.rx);
+        ry = std::min(ry, stk.ry);
+        rs = std::max(rs, stk.rs);
+        rt = std::max(rt, stk.rt);
+    }
+    ++stats.segments;
+    if (segMaxSize > 0 && (rs - rx > segMaxSize * M.RX || rt - ry > segMaxSize * M.RY)) {
+        ++stats.segments_implausible;
+        return false;
+    }
 
-                CellCYK* cd = new CellCYK(G->noTerminales.size(), N);
-                M.setRegion(*cd, stks_list);
+    // Discard unlikely segmentations before running the classifiers. A null
+    // segmentation probability can't yield a valid hypothesis in any case
+    const float seg_prob = segmentation->prob(stkvec, &M);
+    if (!(seg_prob > 0.0) || seg_prob < segProb) {
+        ++stats.segments_low_prob;
+        return true;
+    }
 
-                float seg_prob = segmentation->prob(cd, &M);
+    // With the symbol probability at most 1, this is the best score a terminal could get
+    if (segMinScore > -FLT_MAX && qfactor > 0) {
+        const float bound = log(InsPen) + maxTermScore[size] + gfactor * log(seg_prob);
+        if (bound < segMinScore) {
+            ++stats.segments_bounded;
+            return true;
+        }
+    }
 
-                cmy = sym_rec->clasificar(M, stks_list, NB, clase, pr, asc, des);
+    cmy = classify(M, stkvec, clase, pr, asc, des);
 
-                ntested++;
+    // The cell is only created once a hypothesis is accepted
+    CellCYK* cd = nullptr;
+    for (const auto prod : actTerms) {
+        if (dead(prod->getNoTerm(), size, N)) {
+            ++stats.terminals_dead;
+            continue;
+        }
+        for (int k = 0; k < nbest; k++)
+            if (pr[k] > 0.0 && prod->getClase(clase[k]) && prod->getPrior(clase[k]) > -FLT_MAX) {
 
-                // Add to parsing table
-                bool insertar = false;
-                for (const auto& prod : G->prodTerms) {
-                    for (int k = 0; k < NB; k++)
-                        if (pr[k] > 0.0 && prod->getClase(clase[k]) && prod->getPrior(clase[k]) > -FLT_MAX) {
+                float prob = log(InsPen) + ptfactor * prod->getPrior(clase[k]) + qfactor * log(pr[k]) + dfactor * log(duration->prob(clase[k], size)) + gfactor * log(seg_prob);
 
-                            float prob = log(InsPen) + ptfactor * prod->getPrior(clase[k]) + qfactor * log(pr[k]) + dfactor * log(duration->prob(clase[k], size)) + gfactor * log(seg_prob);
+                if (!cd) {
+                    cd = new CellCYK(G->noTerminales.size(), N);
+                    M.setRegion(*cd, stkvec);
+                }
 
-                            if (cd->noterm[prod->getNoTerm()]) {
-                                if (cd->noterm[prod->getNoTerm()]->pr > prob)
-                                    continue;
+                InternalHypothesis* old = cd->noterm[prod->getNoTerm()];
+                if (old && old->pr > prob) {
+                    if (tcyk.keepsAlternatives())
+                        old->der->splice(derive({ .pt = prod, .pr = prob, .clase = clase[k] }));
+                    continue;
+                }
+                Derivation* prev = old && tcyk.keepsAlternatives() ? old->der : nullptr;
 
-                                cd->noterm[prod->getNoTerm()].reset();
-                            }
+                InternalHypothesis* H = cd->noterm.set(prod->getNoTerm(), InternalHypothesis(clase[k], prob, cd, prod->getNoTerm(), derive({ .pt = prod, .pr = prob, .clase = clase[k] })));
+                if (prev)
+                    H->der->splice(prev);
 
-                            insertar = true;
-
-                            cd->noterm[prod->getNoTerm()] = std::make_unique<InternalHypothesis>(clase[k], prob, cd, prod->getNoTerm());
-                            cd->noterm[prod->getNoTerm()]->pt = prod.get();
-
-                            int cen;
-                            auto type = sym_rec->symType(clase[k]);
-                            if (type == SymbolType::Normal)
-                                cen = cmy;
-                            else if (type == SymbolType::Ascend)
-                                cen = asc;
-                            else if (type == SymbolType::Descend)
-                                cen = des;
-                            else
-                                cen = (cd->t + cd->y) * 0.5; // Middle point
-
-                            // Vertical center
-                            cd->noterm[prod->getNoTerm()]->lcen = cen;
-                            cd->noterm[prod->getNoTerm()]->rcen = cen;
-                        }
-                }
+                int cen;
+                auto type = sym_rec->symType(clase[k]);
+                if (type == SymbolType::Normal)
+                    cen = cmy;
+                else if (type == SymbolType::Ascend)
+                    cen = asc;
+                else if (type == SymbolType::Descend)
+                    cen = des;
+                else
+                    cen = (cd->t + cd->y) * 0.5; // Middle point
 
-                if (insertar) {
-                    tcyk.add(size, cd, -1, G->esInit.get());
-                } else
-                    delete cd;
-            } // end for close_list (VS)
-        } // end for size
+                // Vertical center
+                H->lcen = cen;
+                H->rcen = cen;
+            }
+    }
+
+    if (cd)
+        tcyk.add(size, cd, -1);
 
-    } // end for stroke stkc1
+    return true;
 }
 
 // Combine hypotheses A and B to create new hypothesis S using production 'S -> A B'
@@ -398,28 +605,130 @@ CellCYK* meParser::fusion(Samples& M, ProductionB* pd, InternalHypothesis* A, In
         clase = sym_rec->keyClase(pd->get_outstr()); // will return -1 on non found anyway
 
     // Create hypothesis
-    S->noterm[ps] = std::make_unique<InternalHypothesis>(clase, prob, S, ps);
+    InternalHypothesis* H = S->noterm.set(ps, InternalHypothesis(clase, prob, S, ps));
 
-    pd->mergeRegions(A, B, S->noterm[ps].get());
+    pd->mergeRegions(A, B, H);
+    H->setTermExtent(*A, *B);
 
     // Save the tree path
-    S->noterm[ps]->hi = A;
-    S->noterm[ps]->hd = B;
-    S->noterm[ps]->prod = pd;
+    Derivation der{ .hi = A, .hd = B, .prod = pd, .pr = prob, .clase = clase };
 
     // Special treatment for binary productions that compose terminal symbols (e.g. Equal --V--> Hline Hline)
     if (clase >= 0) {
         for (const auto& prod : G->prodTerms) {
             if (prod->getClase(clase) && prod->getPrior(clase) > -FLT_MAX) {
-                S->noterm[ps]->pt = prod.get();
+                der.pt = prod.get();
+
+                // As a terminal symbol it spans the whole region
+                H->lx = H->rx = S->x;
+                H->ls = H->rs = S->s;
                 break;
             }
         }
     }
 
+    H->der = derive(der);
+
     return S;
 }
 
+// Best-first (A*) search of the most likely start symbol hypothesis covering every stroke,
+// from the terminal hypotheses of tcyk. Returns nullptr if there is none or the budget of
+// items runs out, leaving the table untouched for the CYK algorithm
+const InternalHypothesis* meParser::parseBestFirst(Samples& M, TableCYK& tcyk, Agenda& agenda)
+{
+    // The outside estimate needs the binary productions to never increase the score
+    if (pbfactor < 0 || rfactor < 0)
+        return nullptr;
+
+    const int N = M.nStrokes();
+    for (int n = 1; n <= N; n++)
+        for (CellCYK* c = tcyk.get(n); c; c = c->sig)
+            agenda.bound(c);
+    if (!agenda.seal())
+        return nullptr;
+
+    for (int n = 1; n <= N; n++)
+        for (CellCYK* c = tcyk.get(n); c; c = c->sig)
+            for (const auto& [nt, H] : c->noterm)
+                agenda.push(c, H);
+
+    SpaRel SPR(*gmm_spr, M, stats.relations_scored);
+    const LogSpace regions(nullptr, 0, M.RX, M.RY, windows);
+
+    // Binary productions by spatial relation, the region of B relative to A and its score
+    struct Rule {
+        const std::vector<ProductionB*>& prods;
+        bool (*in)(const LogSpace&, const CellCYK*, const CellCYK*);
+        double (*prob)(SpaRel&, InternalHypothesis*, InternalHypothesis*);
+    };
+    const auto inH = +[](const LogSpace& L, const CellCYK* a, const CellCYK* b) { return L.inH(a, b); };
+    const auto inV = +[](const LogSpace& L, const CellCYK* a, const CellCYK* b) { return L.inV(a, b) || L.inU(b, a); };
+    const Rule rules[] = {
+        { actH, inH, [](SpaRel& R, InternalHypothesis* a, InternalHypothesis* b) { return R.getHorProb(a, b); } },
+        { actSup, inH, [](SpaRel& R, InternalHypothesis* a, InternalHypothesis* b) { return R.getSupProb(a, b); } },
+        { actSub, inH, [](SpaRel& R, InternalHypothesis* a, InternalHypothesis* b) { return R.getSubProb(a, b); } },
+        { actV, inV, [](SpaRel& R, InternalHypothesis* a, InternalHypothesis* b) { return R.getVerProb(a, b); } },
+        { actVe, inV, [](SpaRel& R, InternalHypothesis* a, InternalHypothesis* b) { return R.getVerProb(a, b, true); } },
+        { actIns, [](const LogSpace& L, const CellCYK* a, const CellCYK* b) { return L.inI(a, b); },
+            [](SpaRel& R, InternalHypothesis* a, InternalHypothesis* b) { return R.getInsProb(a, b); } },
+        { actMrt, [](const LogSpace& L, const CellCYK* a, const CellCYK* b) { return L.inM(a, b); },
+            [](SpaRel& R, InternalHypothesis* a, InternalHypothesis* b) { return R.getMrtProb(a, b); } },
+    };
+
+    const auto combine = [&](const Rule& rule, ProductionB* pd, InternalHypothesis* A, InternalHypothesis* B) {
+        if (dead(pd->S, A->parent->talla + B->parent->talla, N)) {
+            ++stats.fusions_dead;
+            return;
+        }
+        if (!A->parent->compatible(B->parent) || !rule.in(regions, A->parent, B->parent))
+            return;
+
+        const double cdpr = rule.prob(SPR, A, B);
+        if (cdpr <= 0.0)
+            return;
+
+        std::unique_ptr<CellCYK> S(fusion(M, pd, A, B, N, cdpr));
+        if (S)
+            agenda.push(S.get(), *S->noterm[pd->S]);
+    };
+
+    // Combine each popped hypothesis with the ones popped before it
+    for (std::size_t popped = 0; (popped < bestFirstItems || !bestFirstItems) && !stopped(); popped++) {
+        InternalHypothesis* X = agenda.pop();
+        if (!X)
+            break;
+        ++stats.agenda_popped;
+
+        if (G->esInit[X->ntid] && agenda.coversAll(X))
+            return X;
+
+        for (const auto& rule : rules)
+            for (const auto pd : rule.prods) {
+                if (pd->A == X->ntid)
+                    for (const auto B : agenda.byNoTerm[pd->B])
+                        combine(rule, pd, X, B);
+                if (pd->B == X->ntid)
+                    for (const auto A : agenda.byNoTerm[pd->A])
+                        combine(rule, pd, A, X);
+            }
+    }
+
+    return nullptr;
+}
+
+// Check whether the table already holds a hypothesis that would make TableCYK::add discard
+// the result of combining A and B with production pd, given an upper bound of the spatial
+// relation probability. The group penalty is at most 1, so the estimate is optimistic
+bool meParser::rejected(TableCYK& tcyk, int n, ProductionB* pd, InternalHypothesis* A, InternalHypothesis* B, double relprob)
+{
+    if (rfactor < 0)
+        return false;
+
+    const float bound = pbfactor * pd->prior + rfactor * log(relprob) + A->pr + B->pr;
+    return tcyk.rejects(n, A->parent, B->parent, pd->S, bound);
+}
+
 void meParser::setMaxHypothesis(unsigned n)
 {
     maxHypothesis = n;
@@ -428,49 +737,195 @@ unsigned meParser::getMaxHypothesis() const
 {
     return maxHypothesis;
 }
+void meParser::setConcurrentClassifiers(bool enable, executor exec)
+{
+    sym_rec->setConcurrent(enable, std::move(exec));
+}
+void meParser::setClassifierCascade(float top, float margin, bool audit)
+{
+    sym_rec->setCascade(top, margin, audit);
+}
+void meParser::setVocabulary(std::span<const std::string> symbols)
+{
+    std::vector<bool> clases(sym_rec->getNClases(), symbols.empty());
+    for (const auto& sym : symbols) {
+        const int k = sym_rec->keyClase(sym);
+        if (k < 0) {
+            std::cerr << "Error: unknown symbol class '" << sym << "'\n";
+            throw std::runtime_error("Error: unknown symbol class");
+        }
+        clases[k] = true;
+    }
+
+    sym_rec->setVocabulary(symbols.empty() ? std::vector<bool>{} : clases);
+    restrictGrammar(clases);
+}
+
+void meParser::setSegmentPruning(float min_prob, float min_score)
+{
+    if (!(min_prob >= 0 && min_prob < 1)) {
+        std::cerr << "Error: segment pruning probability " << min_prob << " is not in [0, 1)\n";
+        throw std::runtime_error("Error: segment pruning probability is not in [0, 1)");
+    }
+    segMinProb = min_prob;
+    segMinScore = min_score;
+}
+
+void meParser::setBestFirst(bool enable, std::size_t max_items)
+{
+    bestFirst = enable;
+    bestFirstItems = max_items;
+}
+
+void meParser::setSearchWindows(const search_windows& w)
+{
+    windows = w;
+}
+const search_windows& meParser::getSearchWindows() const
+{
+    return windows;
+}
+void meParser::setCalibration(WindowCalibration* into)
+{
+    calibration = into;
+}
+void meParser::setLatencyTarget(std::chrono::nanoseconds target)
+{
+    latency.setTarget(target);
+}
+parse_effort meParser::getEffort() const
+{
+    return effort;
+}
+
+const statistics& meParser::getStatistics() const
+{
+    return stats;
+}
+void meParser::resetStatistics()
+{
+    stats = {};
+}
+void meParser::mergeStatistics(meParser& other)
+{
+    stats += other.stats;
+    other.stats = {};
+}
 
 /*************************************
 Parse Math Expression
 **************************************/
-void meParser::parse_me(Samples& M, std::vector<hypothesis>& out)
+bool meParser::parse_me(Samples& M, std::vector<hypothesis>& out, const ParseLimit& lim, Checkpoints* cp)
+{
+    return parse(M, lim, cp, [&](std::span<const InternalHypothesis* const> best) {
+        for (std::size_t mlh_i = 0; mlh_i < best.size(); ++mlh_i) {
+            auto& hyp = out.emplace_back();
+            fillHypothesis(hyp, best[mlh_i]);
+            // printf("hypothesis %zu filled\n", mlh_i);
+        }
+    });
+}
+
+bool meParser::parse_me(Samples& M, forest& out, const ParseLimit& lim)
 {
+    out.clear();
+    forestNodes.clear();
+    forestStrings.clear();
+
+    return parse(M, lim, nullptr, [&](std::span<const InternalHypothesis* const> best) {
+        for (const auto H : best) {
+            out.roots.push_back(makeForest(out, H));
+            out.scores.push_back(H->pr);
+        }
+    });
+}
+
+bool meParser::parse(Samples& M, const ParseLimit& lim, Checkpoints* cp, const std::function<void(std::span<const InternalHypothesis* const>)>& emit)
+{
+    const auto start = std::chrono::steady_clock::now();
+    limit = lim;
+    partial = false;
+    cache = cp;
+
     // Compute the normalized size of a symbol for sample M
     M.detRefSymbol();
 
     const int N = M.nStrokes();
     const int K = G->noTerminales.size();
 
+    // Compute distances and visibility among strokes
+    M.compute_strokes_distances(M.RX, M.RY);
+    proximityGraph(M, N);
+
+    // The time of complete parses tells how long the next ones will take
+    const double work = chooseEffort(N);
+    const auto measure = [&] {
+        if (latency.enabled() && !partial)
+            latency.measure(effort, work, std::chrono::steady_clock::now() - start);
+    };
+
     // Cocke-Younger-Kasami (CYK) algorithm for 2D-SCFG
     TableCYK tcyk(N, K);
     tcyk.SetNumHypotheses(maxHypothesis);
+    derivations.clear();
 
     // printf("CYK table initialization:\n");
     initCYKterms(M, tcyk, N, K);
 
-    // Compute distances and visibility among strokes
-    M.compute_strokes_distances(M.RX, M.RY);
-
     // Spatial structure for retrieving hypotheses within a certain region
     {
         std::vector<std::unique_ptr<LogSpace>> logspace(std::max(2, N));
-        SpaRel SPR(*gmm_spr, M);
+        SpaRel SPR(*gmm_spr, M, stats.relations_scored);
 
         // Init spatial space for size 1
-        logspace[1] = std::make_unique<LogSpace>(tcyk.get(1), tcyk.size(1), M.RX, M.RY);
+        logspace[1] = std::make_unique<LogSpace>(tcyk.get(1), tcyk.size(1), M.RX, M.RY, windows);
 
         // Init the parsing table with several multi-stroke symbol segmentation hypotheses
         combineStrokes(M, tcyk, N);
 
+        // The most likely hypothesis alone can be searched best-first, else the chart is filled
+        if (bestFirst && tcyk.NumHypotheses() == 1) {
+            Agenda agenda(N, K);
+            if (const InternalHypothesis* best = parseBestFirst(M, tcyk, agenda)) {
+                if (calibration)
+                    calibrate(best, M);
+                emit({ &best, 1 });
+                measure();
+                return true;
+            }
+            if (!partial)
+                ++stats.agenda_fallbacks;
+        }
+
         // printf("\nCYK parsing algorithm\n");
         // printf("Size 1: Generated %d\n", tcyk.size(1));
 
+        // Relation probability of the fusion of ha and hb of size talla with production pd, or 0 if
+        // the result can't be kept: the grammar can't fit it in a parse of every stroke, or a better
+        // hypothesis covers its region. The relation is only scored if it can make a difference
+        const auto relate = [&](int talla, ProductionB* pd, InternalHypothesis* ha, InternalHypothesis* hb, const auto& relprob) {
+            if (dead(pd->S, talla, N)) {
+                ++stats.fusions_dead;
+                return 0.0;
+            }
+            if (rejected(tcyk, talla, pd, ha, hb, SpaRel::MAX_PROB)) {
+                ++stats.fusions_bounded;
+                return 0.0;
+            }
+
+            const double cdpr = relprob();
+            if (cdpr <= 0.0 || rejected(tcyk, talla, pd, ha, hb, cdpr))
+                return 0.0;
+            return cdpr;
+        };
+
         // CYK algorithm main loop
-        for (int talla = 2; talla <= std::max(2, N); talla++) {
+        for (int talla = 2; talla <= std::max(2, N) && !partial; talla++) {
 
-            for (int a = 1; a < talla; a++) {
+            for (int a = 1; a < talla && !partial; a++) {
                 int b = talla - a;
 
-                for (CellCYK* c1 = tcyk.get(a); c1; c1 = c1->sig) {
+                for (CellCYK* c1 = tcyk.get(a); c1 && !stopped(); c1 = c1->sig) {
                     // Clear lists
                     c1setH.clear();
                     c1setV.clear();
@@ -491,83 +946,80 @@ void meParser::parse_me(Samples& M, std::vector<hypothesis>& out)
 
                     for (const auto& c2 : c1setH) {
 
-                        for (const auto& it : G->prodsH) {
-                            if (it->prior == -FLT_MAX)
-                                continue;
-
+                        for (const auto it : actH) {
                             // Production S -> A B
                             const int ps = it->S;
                             const int pa = it->A;
                             const int pb = it->B;
 
-                            if (c1->noterm[pa] && c2->noterm[pb]) {
-                                double cdpr = SPR.getHorProb(c1->noterm[pa].get(), c2->noterm[pb].get());
+                            InternalHypothesis* ha = c1->noterm[pa];
+                            InternalHypothesis* hb = c2->noterm[pb];
+                            if (ha && hb) {
+                                const double cdpr = relate(talla, it, ha, hb, [&] { return SPR.getHorProb(ha, hb); });
                                 if (cdpr <= 0.0)
                                     continue;
 
-                                CellCYK* cd = fusion(M, it.get(), c1->noterm[pa].get(), c2->noterm[pb].get(), M.nStrokes(), cdpr);
+                                CellCYK* cd = fusion(M, it, ha, hb, M.nStrokes(), cdpr);
 
                                 if (!cd)
                                     continue;
 
                                 if (cd->noterm[ps]) {
-                                    tcyk.add(talla, cd, ps, G->esInit.get()); // Add to parsing table (size=talla)
+                                    tcyk.add(talla, cd, ps); // Add to parsing table (size=talla)
                                 } else {
-                                    tcyk.add(talla, cd, -1, G->esInit.get()); // Add to parsing table
+                                    tcyk.add(talla, cd, -1); // Add to parsing table
                                 }
                             }
                         }
 
-                        for (const auto& it : G->prodsSup) {
-                            if (it->prior == -FLT_MAX)
-                                continue;
-
+                        for (const auto it : actSup) {
                             // Production S -> A B
                             int ps = it->S;
                             int pa = it->A;
                             int pb = it->B;
 
-                            if (c1->noterm[pa] && c2->noterm[pb]) {
-                                double cdpr = SPR.getSupProb(c1->noterm[pa].get(), c2->noterm[pb].get());
+                            InternalHypothesis* ha = c1->noterm[pa];
+                            InternalHypothesis* hb = c2->noterm[pb];
+                            if (ha && hb) {
+                                const double cdpr = relate(talla, it, ha, hb, [&] { return SPR.getSupProb(ha, hb); });
                                 if (cdpr <= 0.0)
                                     continue;
 
-                                CellCYK* cd = fusion(M, it.get(), c1->noterm[pa].get(), c2->noterm[pb].get(), M.nStrokes(), cdpr);
+                                CellCYK* cd = fusion(M, it, ha, hb, M.nStrokes(), cdpr);
 
                                 if (!cd)
                                     continue;
 
                                 if (cd->noterm[ps]) {
-                                    tcyk.add(talla, cd, ps, G->esInit.get()); // Add to parsing table
+                                    tcyk.add(talla, cd, ps); // Add to parsing table
                                 } else {
-                                    tcyk.add(talla, cd, -1, G->esInit.get()); // Add to parsing table
+                                    tcyk.add(talla, cd, -1); // Add to parsing table
                                 }
                             }
                         }
 
-                        for (const auto& it : G->prodsSub) {
-                            if (it->prior == -FLT_MAX)
-                                continue;
-
+                        for (const auto it : actSub) {
                             // Production S -> A B
                             int ps = it->S;
                             int pa = it->A;
                             int pb = it->B;
 
-                            if (c1->noterm[pa] && c2->noterm[pb]) {
-                                double cdpr = SPR.getSubProb(c1->noterm[pa].get(), c2->noterm[pb].get());
+                            InternalHypothesis* ha = c1->noterm[pa];
+                            InternalHypothesis* hb = c2->noterm[pb];
+                            if (ha && hb) {
+                                const double cdpr = relate(talla, it, ha, hb, [&] { return SPR.getSubProb(ha, hb); });
                                 if (cdpr <= 0.0)
                                     continue;
 
-                                CellCYK* cd = fusion(M, it.get(), c1->noterm[pa].get(), c2->noterm[pb].get(), M.nStrokes(), cdpr);
+                                CellCYK* cd = fusion(M, it, ha, hb, M.nStrokes(), cdpr);
 
                                 if (!cd)
                                     continue;
 
                                 if (cd->noterm[ps]) {
-                                    tcyk.add(talla, cd, ps, G->esInit.get()); // Add to parsing table
+                                    tcyk.add(talla, cd, ps); // Add to parsing table
                                 } else {
-                                    tcyk.add(talla, cd, -1, G->esInit.get()); // Add to parsing table
+                                    tcyk.add(talla, cd, -1); // Add to parsing table
                                 }
                             }
                         }
@@ -576,56 +1028,54 @@ void meParser::parse_me(Samples& M, std::vector<hypothesis>& out)
 
                     for (const auto& c2 : c1setV) {
 
-                        for (const auto& it : G->prodsV) {
-                            if (it->prior == -FLT_MAX)
-                                continue;
-
+                        for (const auto it : actV) {
                             // Production S -> A B
                             int ps = it->S;
                             int pa = it->A;
                             int pb = it->B;
 
-                            if (c1->noterm[pa] && c2->noterm[pb]) {
-                                double cdpr = SPR.getVerProb(c1->noterm[pa].get(), c2->noterm[pb].get());
+                            InternalHypothesis* ha = c1->noterm[pa];
+                            InternalHypothesis* hb = c2->noterm[pb];
+                            if (ha && hb) {
+                                const double cdpr = relate(talla, it, ha, hb, [&] { return SPR.getVerProb(ha, hb); });
                                 if (cdpr <= 0.0)
                                     continue;
 
-                                CellCYK* cd = fusion(M, it.get(), c1->noterm[pa].get(), c2->noterm[pb].get(), M.nStrokes(), cdpr);
+                                CellCYK* cd = fusion(M, it, ha, hb, M.nStrokes(), cdpr);
 
                                 if (!cd)
                                     continue;
 
                                 if (cd->noterm[ps])
-                                    tcyk.add(talla, cd, ps, G->esInit.get()); // Add to parsing table
+                                    tcyk.add(talla, cd, ps); // Add to parsing table
                                 else
-                                    tcyk.add(talla, cd, -1, G->esInit.get()); // Add to parsing table
+                                    tcyk.add(talla, cd, -1); // Add to parsing table
                             }
                         }
 
                         // prodsVe
-                        for (const auto& it : G->prodsVe) {
-                            if (it->prior == -FLT_MAX)
-                                continue;
-
+                        for (const auto it : actVe) {
                             // Production S -> A B
                             int ps = it->S;
                             int pa = it->A;
                             int pb = it->B;
 
-                            if (c1->noterm[pa] && c2->noterm[pb]) {
-                                double cdpr = SPR.getVerProb(c1->noterm[pa].get(), c2->noterm[pb].get(), true);
+                            InternalHypothesis* ha = c1->noterm[pa];
+                            InternalHypothesis* hb = c2->noterm[pb];
+                            if (ha && hb) {
+                                const double cdpr = relate(talla, it, ha, hb, [&] { return SPR.getVerProb(ha, hb, true); });
                                 if (cdpr <= 0.0)
                                     continue;
 
-                                CellCYK* cd = fusion(M, it.get(), c1->noterm[pa].get(), c2->noterm[pb].get(), M.nStrokes(), cdpr);
+                                CellCYK* cd = fusion(M, it, ha, hb, M.nStrokes(), cdpr);
 
                                 if (!cd)
                                     continue;
 
                                 if (cd->noterm[ps]) {
-                                    tcyk.add(talla, cd, ps, G->esInit.get()); // Add to parsing table
+                                    tcyk.add(talla, cd, ps); // Add to parsing table
                                 } else {
-                                    tcyk.add(talla, cd, -1, G->esInit.get()); // Add to parsing table
+                                    tcyk.add(talla, cd, -1); // Add to parsing table
                                 }
                             }
                         }
@@ -634,57 +1084,55 @@ void meParser::parse_me(Samples& M, std::vector<hypothesis>& out)
 
                     for (const auto& c2 : c1setU) {
 
-                        for (const auto& it : G->prodsV) {
-                            if (it->prior == -FLT_MAX)
-                                continue;
-
+                        for (const auto it : actV) {
                             // Production S -> A B
                             int ps = it->S;
                             int pa = it->A;
                             int pb = it->B;
 
-                            if (c1->noterm[pb] && c2->noterm[pa]) {
-                                double cdpr = SPR.getVerProb(c2->noterm[pa].get(), c1->noterm[pb].get());
+                            InternalHypothesis* ha = c2->noterm[pa];
+                            InternalHypothesis* hb = c1->noterm[pb];
+                            if (ha && hb) {
+                                const double cdpr = relate(talla, it, ha, hb, [&] { return SPR.getVerProb(ha, hb); });
                                 if (cdpr <= 0.0)
                                     continue;
 
-                                CellCYK* cd = fusion(M, it.get(), c2->noterm[pa].get(), c1->noterm[pb].get(), M.nStrokes(), cdpr);
+                                CellCYK* cd = fusion(M, it, ha, hb, M.nStrokes(), cdpr);
 
                                 if (!cd)
                                     continue;
 
                                 if (cd->noterm[ps]) {
-                                    tcyk.add(talla, cd, ps, G->esInit.get()); // Add to parsing table
+                                    tcyk.add(talla, cd, ps); // Add to parsing table
                                 } else {
-                                    tcyk.add(talla, cd, -1, G->esInit.get()); // Add to parsing table
+                                    tcyk.add(talla, cd, -1); // Add to parsing table
                                 }
                             }
                         }
 
                         // ProdsVe
-                        for (const auto& it : G->prodsVe) {
-                            if (it->prior == -FLT_MAX)
-                                continue;
-
+                        for (const auto it : actVe) {
                             // Production S -> A B
                             int ps = it->S;
                             int pa = it->A;
                             int pb = it->B;
 
-                            if (c1->noterm[pb] && c2->noterm[pa]) {
-                                double cdpr = SPR.getVerProb(c2->noterm[pa].get(), c1->noterm[pb].get(), true);
+                            InternalHypothesis* ha = c2->noterm[pa];
+                            InternalHypothesis* hb = c1->noterm[pb];
+                            if (ha && hb) {
+                                const double cdpr = relate(talla, it, ha, hb, [&] { return SPR.getVerProb(ha, hb, true); });
                                 if (cdpr <= 0.0)
                                     continue;
 
-                                CellCYK* cd = fusion(M, it.get(), c2->noterm[pa].get(), c1->noterm[pb].get(), M.nStrokes(), cdpr);
+                                CellCYK* cd = fusion(M, it, ha, hb, M.nStrokes(), cdpr);
 
                                 if (!cd)
                                     continue;
 
                                 if (cd->noterm[ps]) {
-                                    tcyk.add(talla, cd, ps, G->esInit.get()); // Add to parsing table
+                                    tcyk.add(talla, cd, ps); // Add to parsing table
                                 } else {
-                                    tcyk.add(talla, cd, -1, G->esInit.get()); // Add to parsing table
+                                    tcyk.add(talla, cd, -1); // Add to parsing table
                                 }
                             }
                         }
@@ -692,29 +1140,28 @@ void meParser::parse_me(Samples& M, std::vector<hypothesis>& out)
 
                     for (const auto& c2 : c1setI) {
 
-                        for (const auto& it : G->prodsIns) {
-                            if (it->prior == -FLT_MAX)
-                                continue;
-
+                        for (const auto it : actIns) {
                             // Production S -> A B
                             const int ps = it->S;
                             const int pa = it->A;
                             const int pb = it->B;
 
-                            if (c1->noterm[pa] && c2->noterm[pb]) {
-                                double cdpr = SPR.getInsProb(c1->noterm[pa].get(), c2->noterm[pb].get());
+                            InternalHypothesis* ha = c1->noterm[pa];
+                            InternalHypothesis* hb = c2->noterm[pb];
+                            if (ha && hb) {
+                                const double cdpr = relate(talla, it, ha, hb, [&] { return SPR.getInsProb(ha, hb); });
                                 if (cdpr <= 0.0)
                                     continue;
 
-                                CellCYK* cd = fusion(M, it.get(), c1->noterm[pa].get(), c2->noterm[pb].get(), M.nStrokes(), cdpr);
+                                CellCYK* cd = fusion(M, it, ha, hb, M.nStrokes(), cdpr);
 
                                 if (!cd)
                                     continue;
 
                                 if (cd->noterm[ps]) {
-                                    tcyk.add(talla, cd, ps, G->esInit.get()); // Add to parsing table
+                                    tcyk.add(talla, cd, ps); // Add to parsing table
                                 } else {
-                                    tcyk.add(talla, cd, -1, G->esInit.get()); // Add to parsing table
+                                    tcyk.add(talla, cd, -1); // Add to parsing table
                                 }
                             }
                         }
@@ -722,29 +1169,28 @@ void meParser::parse_me(Samples& M, std::vector<hypothesis>& out)
 
                     // Mroot
                     for (const auto& c2 : c1setM) {
-                        for (const auto& it : G->prodsMrt) {
-                            if (it->prior == -FLT_MAX)
-                                continue;
-
+                        for (const auto it : actMrt) {
                             // Production S -> A B
                             int ps = it->S;
                             int pa = it->A;
                             int pb = it->B;
 
-                            if (c1->noterm[pa] && c2->noterm[pb]) {
-                                double cdpr = SPR.getMrtProb(c1->noterm[pa].get(), c2->noterm[pb].get());
+                            InternalHypothesis* ha = c1->noterm[pa];
+                            InternalHypothesis* hb = c2->noterm[pb];
+                            if (ha && hb) {
+                                const double cdpr = relate(talla, it, ha, hb, [&] { return SPR.getMrtProb(ha, hb); });
                                 if (cdpr <= 0.0)
                                     continue;
 
-                                CellCYK* cd = fusion(M, it.get(), c1->noterm[pa].get(), c2->noterm[pb].get(), M.nStrokes(), cdpr);
+                                CellCYK* cd = fusion(M, it, ha, hb, M.nStrokes(), cdpr);
 
                                 if (!cd)
                                     continue;
 
                                 if (cd->noterm[ps]) {
-                                    tcyk.add(talla, cd, ps, G->esInit.get()); // Add to parsing table
+                                    tcyk.add(talla, cd, ps); // Add to parsing table
                                 } else {
-                                    tcyk.add(talla, cd, -1, G->esInit.get()); // Add to parsing table
+                                    tcyk.add(talla, cd, -1); // Add to parsing table
                                 }
                             }
                         }
@@ -752,38 +1198,42 @@ void meParser::parse_me(Samples& M, std::vector<hypothesis>& out)
                     // End Mroot
 
                     // Look for combining {x_subs} y {x^sups} in {x_subs^sups}
-                    for (int pps = 0; pps < c1->nnt; pps++) {
+                    for (const auto& [pps, sub] : c1->noterm) {
 
                         // If c1->noterm[pa] is a InternalHypothesis of a subscript (parent_son)
-                        if (c1->noterm[pps] && c1->noterm[pps]->prod && c1->noterm[pps]->prod->tipo() == 'B') {
+                        if (sub.der->prod && sub.der->prod->tipo() == 'B') {
 
-                            logspace[b + c1->noterm[pps]->hi->parent->talla]->getS(c1, c1setS); // sup/sub-scripts union
+                            logspace[b + sub.der->hi->parent->talla]->getS(c1, c1setS); // sup/sub-scripts union
 
                             for (const auto& c2 : c1setS) {
                                 if (c2->x != c1->x || c1 != c2)
                                     continue;
 
-                                for (const auto& it : G->prodsSSE) {
-                                    if (it->prior == -FLT_MAX)
-                                        continue;
-
+                                for (const auto it : actSSE) {
                                     // Production S -> A B
                                     const int ps = it->S;
                                     const int pa = it->A;
                                     const int pb = it->B;
 
-                                    if (c1->noterm[pa] && c2->noterm[pb] && c1->noterm[pa]->prod && c2->noterm[pb]->prod && c1->noterm[pa]->hi == c2->noterm[pb]->hi && c1->noterm[pa]->prod->tipo() == 'B' && c2->noterm[pb]->prod->tipo() == 'P' && c1->noterm[pa]->hd->parent->compatible(c2->noterm[pb]->hd->parent)) {
+                                    const InternalHypothesis* ha = c1->noterm[pa];
+                                    const InternalHypothesis* hb = c2->noterm[pb];
+                                    if (!ha || !hb)
+                                        continue;
+
+                                    const Derivation* da = ha->der;
+                                    const Derivation* db = hb->der;
+                                    if (da->prod && db->prod && da->hi == db->hi && da->prod->tipo() == 'B' && db->prod->tipo() == 'P' && da->hd->parent->compatible(db->hd->parent)) {
 
                                         // Subscript and superscript should start almost vertically aligned
-                                        if (abs(c1->noterm[pa]->hd->parent->x - c2->noterm[pb]->hd->parent->x) > 3 * M.RX)
+                                        if (abs(da->hd->parent->x - db->hd->parent->x) > 3 * M.RX)
                                             continue;
                                         // Subscript and superscript should not overlap
-                                        if (std::max(it->solape(c1->noterm[pa]->hd, c2->noterm[pb]->hd),
-                                                     it->solape(c2->noterm[pb]->hd, c1->noterm[pa]->hd))
+                                        if (std::max(it->solape(da->hd, db->hd),
+                                                     it->solape(db->hd, da->hd))
                                             > 0.1)
                                             continue;
 
-                                        float prob = c1->noterm[pa]->pr + c2->noterm[pb]->pr - c1->noterm[pa]->hi->pr;
+                                        float prob = ha->pr + hb->pr - da->hi->pr;
 
                                         CellCYK* cd = new CellCYK(G->noTerminales.size(), M.nStrokes());
 
@@ -792,34 +1242,31 @@ void meParser::parse_me(Samples& M, std::vector<hypothesis>& out)
                                         cd->s = std::max(c1->s, c2->s);
                                         cd->t = std::max(c1->t, c2->t);
 
-                                        cd->noterm[ps] = std::make_unique<InternalHypothesis>(-1, prob, cd, ps);
+                                        // Save the production of the superscript in order to recover it when printing the used productions
+                                        InternalHypothesis* H = cd->noterm.set(ps, InternalHypothesis(-1, prob, cd, ps, derive({ .hi = ha, .hd = db->hd, .prod = it, .prod_sse = db->prod, .pr = prob })));
 
-                                        cd->noterm[ps]->lcen = c1->noterm[pa]->lcen;
-                                        cd->noterm[ps]->rcen = c1->noterm[pa]->rcen;
+                                        H->lcen = ha->lcen;
+                                        H->rcen = ha->rcen;
                                         cd->ccUnion(c1, c2);
 
-                                        cd->noterm[ps]->hi = c1->noterm[pa].get();
-                                        cd->noterm[ps]->hd = c2->noterm[pb]->hd;
-                                        cd->noterm[ps]->prod = it.get();
-                                        // Save the production of the superscript in order to recover it when printing the used productions
-                                        cd->noterm[ps]->prod_sse = c2->noterm[pb]->prod;
+                                        H->setTermExtent(*ha, *db->hd);
 
-                                        tcyk.add(talla, cd, ps, G->esInit.get());
+                                        tcyk.add(talla, cd, ps);
                                     }
                                 }
                             } // end for c2 in c1setS
 
                             c1setS.clear();
                         }
-                    } // end for(int pps=0; pps<c1->nnt; pps++)
+                    } // end for pps in c1->noterm
 
                 } // end for(CellCYK *c1=tcyk.get(a); c1; c1=c1->sig)
 
             } // for 1 <= a < talla
 
-            if (talla < std::max(2, N)) {
+            if (talla < std::max(2, N) && !partial) {
                 // Create new logspace structure of size "talla"
-                logspace[talla] = std::make_unique<LogSpace>(tcyk.get(talla), tcyk.size(talla), M.RX, M.RY);
+                logspace[talla] = std::make_unique<LogSpace>(tcyk.get(talla), tcyk.size(talla), M.RX, M.RY, windows);
             }
 
             // printf("Size %d: Generated %d\n", talla, tcyk.size(talla));
@@ -829,20 +1276,43 @@ void meParser::parse_me(Samples& M, std::vector<hypothesis>& out)
         // Free memory
     }
 
-    // Get Most Likely InternalHypothesis
-    for (int mlh_i = 0; mlh_i < tcyk.NumHypotheses(); ++mlh_i) {
-        InternalHypothesis* mlh = tcyk.getMLH(mlh_i);
-
-        if (!mlh)
-            break;
+    // Get the most likely hypotheses, enumerating alternative derivations on demand. If the
+    // parse was cut short, these are the ones covering the most strokes in the table so far
+    if (partial)
+        ++stats.partial_parses;
+
+    KBest kbest;
+    const auto best = kbest.best(tcyk.roots(G->esInit.get()), tcyk.NumHypotheses());
+    if (calibration && !partial && !best.empty())
+        calibrate(best[0], M);
+    emit(best);
+    measure();
+    return !partial;
+}
 
-        if (mlh->parent->talla == 0)
-            break;
+// Record the spatial relations of the derivation of H for the window calibration
+void meParser::calibrate(const InternalHypothesis* H, const Samples& M)
+{
+    const Derivation* der = H->der;
+    if (!der->prod)
+        return;
 
-        auto& hyp = out.emplace_back();
-        fillHypothesis(hyp, mlh);
-        printf("hypothesis %d filled\n", mlh_i);
+    if (der->prod->tipo() == 'S') {
+        // {x_sub^sup}: the superscript relation is only kept with its production
+        calibration->add('P', der->hi->der->hi->parent, der->hd->parent, M.RX, M.RY);
+    } else {
+        calibration->add(der->prod->tipo(), der->hi->parent, der->hd->parent, M.RX, M.RY);
     }
+    calibrate(der->hi, M);
+    calibrate(der->hd, M);
+}
+
+// Whether the parse has to give up now
+bool meParser::stopped()
+{
+    if (!partial && limit.reached())
+        partial = true;
+    return partial;
 }
 
 /*************************************
@@ -874,53 +1344,19 @@ void meParser::fillHypothesis(hypothesis& into, const InternalHypothesis* H)
 #endif
 }
 #ifdef SESHAT_HYPOTHESIS_TREE
-int meParser::makeTree(hypothesis& into, const InternalHypothesis* H, int id)
-{
-    /*
-    if (!H->pt) {
-        const auto self_token_idx = into.tokens.size();
-        const char* self_token = G->key2str(H->ntid);
-        const char* token_A = G->key2str(H->prod->A);
-        const char* token_B = G->key2str(H->prod->B);
-        into.tokens.emplace_back(self_token);
-        printf("binary token %s at id %zd\n", self_token, self_token_idx);
-        printf("what is %s\n", token_A);
-        printf("what is %s\n", token_B);
-
-        const int a = makeTree(into, H->hi, self_token_idx);
-        into.relations.emplace_back(self_token_idx, a);
-        printf("relation A p %zd, c %d\n", self_token_idx, a);
-
-        const int b = makeTree(into, H->hd, self_token_idx);
-        into.relations.emplace_back(self_token_idx, b);
-
-        printf("relation B p %zd, c %d\n", self_token_idx, b);
-        return self_token_idx;
-    } else {
-        std::string aux = H->pt->getTeX(H->clase);
-        into.tokens[id].data = aux;
-        printf("terminal token %s replace at id %zd\n", aux.c_str(), id);
-        return id;
-    }
-    */
-
-    const int self_id = into.relations.size();
-    into.relations.emplace_back();
+// Add the derivation of H to the tree, returning the id of its token
+std::size_t meParser::makeTree(hypothesis& into, const InternalHypothesis* H)
+{
+    const std::size_t self_id = into.tokens.size();
 
-    if (!H->pt) {
+    if (!H->der->pt) {
         // Binary production
-        printf("Node%d [label=\"%s\"]\n", self_id, G->key2str(H->ntid));
-
-        const int subid_a = into.relations.size();
-        printf("Node%d -> Node%d [label=\"left\"]\n", self_id, subid_a);
-        makeTree(into, H->hi, self_id);
-
-        const int subid_b = into.relations.size();
-        printf("Node%d -> Node%d [label=\"right\"]\n", self_id, subid_b);
-        makeTree(into, H->hd, self_id);
+        into.tokens.push_back({ G->key2str(H->ntid) });
+        for (const InternalHypothesis* sub : { H->der->hi, H->der->hd })
+            into.relations.push_back({ self_id, makeTree(into, sub) });
     } else {
         // Terminal production
-        printf("Node%d [shape=box,label=\"%s\"]\n", self_id, H->pt->getTeX(H->clase));
+        into.tokens.push_back({ H->der->pt->getTeX(H->clase) });
     }
 
     return self_id;
@@ -929,12 +1365,51 @@ int meParser::makeTree(hypothesis& into, const InternalHypothesis* H, int id)
 // fill with LaTeX string
 void meParser::makeLatex(hypothesis& into, const InternalHypothesis* H)
 {
-    if (!H->pt) {
+    if (!H->der->pt) {
         std::ostringstream os;
-        H->prod->printOut(os, *G, H);
+        H->der->prod->printOut(os, *G, H);
         into.repr = os.str();
     } else {
-        into.repr = H->pt->getTeX(H->clase);
+        into.repr = H->der->pt->getTeX(H->clase);
     }
 }
 #endif
+
+// Add the derivation of H to the forest, reusing the nodes of the subtrees already there
+std::uint32_t meParser::makeForest(forest& into, const InternalHypothesis* H)
+{
+    if (const auto it = forestNodes.find(H); it != forestNodes.end())
+        return it->second;
+
+    forest::node n;
+    n.symbol = intern(into, G->key2str(H->ntid));
+
+    if (H->der->pt) {
+        n.text[0] = intern(into, H->der->pt->getTeX(H->clase));
+    } else {
+        const auto L = H->der->prod->layout();
+        const InternalHypothesis* sub[2] = { H->der->hi, H->der->hd };
+
+        for (int k = 0; k < 3; k++)
+            n.text[k] = intern(into, L.text[k]);
+        for (int k = 0; k < 2; k++)
+            if (L.child[k] >= 0)
+                n.child[k] = makeForest(into, sub[L.child[k]]);
+    }
+
+    const std::uint32_t id = into.nodes.size();
+    into.nodes.push_back(n);
+    forestNodes.emplace(H, id);
+    return id;
+}
+
+std::uint32_t meParser::intern(forest& into, std::string_view str)
+{
+    if (str.empty())
+        return 0;
+
+    const auto [it, fresh] = forestStrings.try_emplace(str, into.strings.size());
+    if (fresh)
+        into.strings.emplace_back(str);
+    return it->second;
+}
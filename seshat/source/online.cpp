@@ -118,7 +118,7 @@ sentence sentence::smoothed(int cont_size) const
             sum_x = 0;
             sum_y = 0;
             for (int c = p - cont_size; c <= p + cont_size; c++) {
-                const int pt_idx = std::clamp(c, 0, np);
+                const int pt_idx = std::clamp(c, 0, np - 1);
                 sum_x += Points[pt_idx].x;
                 sum_y += Points[pt_idx].y;
             }
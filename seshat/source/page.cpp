@@ -0,0 +1,106 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <numeric>
+#include <page.hpp>
+#include <samples.hpp>
+
+using namespace seshat;
+
+static int findRoot(std::vector<int>& parent, int i)
+{
+    while (parent[i] != i)
+        i = parent[i] = parent[parent[i]];
+    return i;
+}
+
+std::vector<PageRegion> seshat::segmentPage(std::span<const Stroke> strokes, float hgap, float vgap)
+{
+    const int N = strokes.size();
+    if (!N)
+        return {};
+
+    const auto [RX, RY] = Samples::refSymbol(strokes);
+    const float maxdx = hgap * RX;
+    const float maxdy = vgap * RY;
+
+    // Sweep the strokes from left to right: once a stroke starts farther than maxdx from
+    // the end of another one, so does every stroke after it
+    std::vector<int> order(N);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return strokes[a].rx < strokes[b].rx; });
+
+    std::vector<int> parent(N);
+    std::iota(parent.begin(), parent.end(), 0);
+    for (int a = 0; a < N; a++) {
+        const Stroke& si = strokes[order[a]];
+        for (int b = a + 1; b < N; b++) {
+            const Stroke& sj = strokes[order[b]];
+            if (sj.rx - si.rs > maxdx)
+                break;
+
+            const int dy = std::max(sj.ry - si.rt, si.ry - sj.rt);
+            if (dy <= maxdy)
+                parent[findRoot(parent, order[a])] = findRoot(parent, order[b]);
+        }
+    }
+
+    std::vector<PageRegion> regions;
+    std::vector<int> region(N, -1);
+    for (int i = 0; i < N; i++) {
+        int& r = region[findRoot(parent, i)];
+        if (r < 0) {
+            r = regions.size();
+            regions.push_back({ {}, INT_MAX, INT_MAX, -INT_MAX, -INT_MAX });
+        }
+
+        auto& reg = regions[r];
+        reg.strokes.push_back(i);
+        reg.rx = std::min(reg.rx, strokes[i].rx);
+        reg.ry = std::min(reg.ry, strokes[i].ry);
+        reg.rs = std::max(reg.rs, strokes[i].rs);
+        reg.rt = std::max(reg.rt, strokes[i].rt);
+    }
+
+    // Reading order: going down the page, a region that overlaps vertically with the current line
+    // of text continues it, otherwise it starts a new line. Each line is then read from left to right
+    std::sort(regions.begin(), regions.end(), [](const PageRegion& a, const PageRegion& b) { return a.ry < b.ry; });
+
+    std::vector<std::pair<int, int>> key(regions.size()); // (line, rx)
+    for (int r = 0, line = -1, bottom = 0; r < (int)regions.size(); r++) {
+        const auto& reg = regions[r];
+        if (line < 0 || reg.ry > bottom) {
+            line++;
+            bottom = reg.rt;
+        } else {
+            bottom = std::max(bottom, reg.rt);
+        }
+        key[r] = { line, reg.rx };
+    }
+
+    std::vector<int> sorted(regions.size());
+    std::iota(sorted.begin(), sorted.end(), 0);
+    std::stable_sort(sorted.begin(), sorted.end(), [&](int a, int b) { return key[a] < key[b]; });
+
+    std::vector<PageRegion> ordered;
+    ordered.reserve(regions.size());
+    for (const int r : sorted)
+        ordered.push_back(std::move(regions[r]));
+    return ordered;
+}
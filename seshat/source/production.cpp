@@ -61,12 +61,14 @@ ProductionB::ProductionB(int s, int a, int b, float pr, const std::string& out)
     , B{ b }
 {
     prior = pr > 0.0 ? log(pr) : -FLT_MAX;
+    pos1 = check_str(outStr, "$1");
+    pos2 = check_str(outStr, "$2");
 
     setMerges('C');
 }
 
 // Percentage of the are of regin A that overlaps with region B
-float ProductionB::solape(InternalHypothesis* a, InternalHypothesis* b)
+float ProductionB::solape(const InternalHypothesis* a, const InternalHypothesis* b)
 {
     int x = std::max(a->parent->x, b->parent->x);
     int y = std::max(a->parent->y, b->parent->y);
@@ -85,9 +87,7 @@ float ProductionB::solape(InternalHypothesis* a, InternalHypothesis* b)
 
 bool ProductionB::check_out()
 {
-    if (check_str(outStr, "$1") < 0 && check_str(outStr, "$2") < 0)
-        return false;
-    return true;
+    return pos1 >= 0 || pos2 >= 0;
 }
 
 const std::string& ProductionB::get_outstr() const
@@ -95,55 +95,53 @@ const std::string& ProductionB::get_outstr() const
     return outStr;
 }
 
+ProductionB::OutLayout ProductionB::layout() const
+{
+    const std::string_view str = outStr;
+    OutLayout L;
+
+    int n = 0, i = 0;
+    const auto take = [&](int pos, int child) {
+        L.text[n] = str.substr(i, pos - i);
+        L.child[n++] = child;
+        i = pos + 2;
+    };
+
+    if (pos1 >= 0 && pos2 >= 0 && pos2 < pos1) {
+        take(pos2, 1);
+        take(pos1, 0);
+    } else {
+        if (pos1 >= 0)
+            take(pos1, 0);
+        if (pos2 >= 0)
+            take(pos2, 1);
+    }
+    L.text[n] = str.substr(i);
+
+    return L;
+}
+
 void ProductionB::printOut(std::ostream& os, Grammar& G, const InternalHypothesis* H)
 {
     if (outStr.empty())
         return;
 
-    std::string_view outStrv = outStr;
+    const OutLayout L = layout();
+    const InternalHypothesis* sub[2] = { H->der->hi, H->der->hd };
 
-    int pd1 = check_str(outStrv, "$1");
-    int pd2 = check_str(outStrv, "$2");
+    for (int k = 0; k < 2; k++) {
+        os << L.text[k];
+        if (L.child[k] < 0)
+            continue;
 
-    int i = 0;
-    if (pd2 >= 0 && pd1 >= 0 && pd2 < pd1) {
-        os << outStrv.substr(i, pd2 - i);
-        i = pd2 + 2;
-
-        if (H->hd->clase < 0)
-            H->hd->prod->printOut(os, G, H->hd);
+        const InternalHypothesis* C = sub[L.child[k]];
+        if (C->clase < 0)
+            C->der->prod->printOut(os, G, C);
         else
-            os << H->hd->pt->getTeX(H->hd->clase);
-
-        os << outStrv.substr(i, pd1 - i);
-        i = pd1 + 2;
-
-        if (H->hi->clase < 0)
-            H->hi->prod->printOut(os, G, H->hi);
-        else
-            os << H->hi->pt->getTeX(H->hi->clase);
-    } else {
-        if (pd1 >= 0) {
-            os << outStrv.substr(i, pd1 - i);
-            i = pd1 + 2;
-
-            if (H->hi->clase < 0)
-                H->hi->prod->printOut(os, G, H->hi);
-            else
-                os << H->hi->pt->getTeX(H->hi->clase);
-        }
-        if (pd2 >= 0) {
-            os << outStrv.substr(i, pd2 - i);
-            i = pd2 + 2;
-
-            if (H->hd->clase < 0)
-                H->hd->prod->printOut(os, G, H->hd);
-            else
-                os << H->hd->pt->getTeX(H->hd->clase);
-        }
+            os << C->der->pt->getTeX(C->clase);
     }
 
-    os << outStrv.substr(i);
+    os << L.text[2];
 }
 
 void ProductionB::setMerges(char c)
@@ -0,0 +1,128 @@
+/*Copyright 2014 Francisco Alvaro
+
+ This file is part of SESHAT.
+
+    SESHAT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SESHAT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <algorithm>
+#include <seshat/recognizer.hpp>
+
+using namespace seshat;
+
+async_recognizer::async_recognizer(math_expression& r, callback cb)
+    : recog{ r }
+    , on_result{ std::move(cb) }
+    , worker{ [this](std::stop_token stop) { work(std::move(stop)); } }
+{
+}
+
+async_recognizer::~async_recognizer()
+{
+    {
+        std::lock_guard lock(mtx);
+        inflight.request_stop();
+    }
+    worker.request_stop();
+    worker.join();
+
+    delete mailbox.exchange(nullptr);
+}
+
+std::uint64_t async_recognizer::submit(sample s)
+{
+    auto req = std::make_unique<request>(0, std::move(s));
+    std::uint64_t id;
+    {
+        std::lock_guard lock(mtx);
+        id = req->id = ++submitted;
+        pending = std::move(req);
+        inflight.request_stop();
+    }
+    wake.notify_one();
+    return id;
+}
+
+std::optional<async_recognizer::result> async_recognizer::take()
+{
+    std::unique_ptr<result> res{ mailbox.exchange(nullptr, std::memory_order_acquire) };
+    if (!res)
+        return std::nullopt;
+    return std::move(*res);
+}
+
+bool async_recognizer::busy() const
+{
+    return finished.load() != submitted.load();
+}
+
+void async_recognizer::work(std::stop_token stop)
+{
+    while (true) {
+        std::unique_ptr<request> req;
+        std::stop_token cancel;
+        {
+            std::unique_lock lock(mtx);
+            if (!wake.wait(lock, stop, [this] { return pending != nullptr; }))
+                return;
+            req = std::move(pending);
+            inflight = {};
+            cancel = inflight.get_token();
+        }
+
+        auto res = std::make_unique<result>(req->id);
+        auto status = parse_status::complete;
+        try {
+            feed(req->s);
+            status = recog.parse_strokes(res->hypotheses, cancel);
+        } catch (...) {
+            // Reported like a result, the worker keeps going
+            res->hypotheses.clear();
+            res->error = std::current_exception();
+            recog.clear_strokes();
+            fed.clear();
+        }
+
+        // A partial result means a newer sample (or shutdown) took over
+        if (status == parse_status::complete) {
+            if (on_result)
+                on_result(std::move(*res));
+            else
+                delete mailbox.exchange(res.release(), std::memory_order_acq_rel);
+        }
+        finished.store(req->id);
+    }
+}
+
+// Bring the strokes of recog in line with s, keeping those they have in common
+void async_recognizer::feed(sample& s)
+{
+    const auto same = [](const sample::stroke& a, const sample::stroke& b) {
+        return std::equal(a.points.begin(), a.points.end(), b.points.begin(), b.points.end(), [](const point& p, const point& q) {
+            return p.x == q.x && p.y == q.y;
+        });
+    };
+
+    std::size_t keep = 0;
+    while (keep < fed.size() && keep < s.strokes.size() && same(fed[keep], s.strokes[keep]))
+        keep++;
+
+    while (recog.stroke_count() > keep)
+        recog.remove_last_stroke();
+    for (std::size_t k = keep; k < s.strokes.size(); k++) {
+        recog.begin_stroke();
+        recog.add_points(s.strokes[k].points);
+        recog.end_stroke();
+    }
+    fed = std::move(s.strokes);
+}
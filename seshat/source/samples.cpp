@@ -25,9 +25,9 @@
 #include <cstring>
 #include <iostream>
 #include <map>
-#include <numeric>
 #include <queue>
 #include <samples.hpp>
+#include <tuple>
 #include <vector>
 
 using namespace seshat;
@@ -53,9 +53,10 @@ static bool isRelation(const char* str)
 
 void Samples::clearAll()
 {
-    vmedx.clear();
-    vmedy.clear();
     dataon.clear();
+    xs.clear();
+    ys.clear();
+    nfinished = 0;
     stk_dis.img.clear();
     stk_dis.width = 0;
     stk_dis.height = 0;
@@ -66,13 +67,146 @@ void Samples::clearAll()
     dataoff.width = 0;
     dataoff.height = 0;
 }
+void Samples::beginStroke()
+{
+    auto& stk = dataon.emplace_back();
+    stk.px = xs.data() + xs.size();
+    stk.py = ys.data() + ys.size();
+    stk.closest.assign(dataon.size() - 1, { FLT_MAX, -1, -1 });
+}
+
+// Point the strokes to their points again after xs/ys grew
+void Samples::rebase()
+{
+    std::size_t first = 0;
+    for (auto& stk : dataon) {
+        stk.px = xs.data() + first;
+        stk.py = ys.data() + first;
+        first += stk.np;
+    }
+}
+
+// Keep the closest pair of the last stroke to every previous stroke (first one found
+// scanning the previous stroke's points in order, as ties are broken when computing distances)
+void Samples::updateClosest(int np, const Point& p)
+{
+    const int last = nStrokes() - 1;
+    auto& stk = dataon[last];
+
+    for (int j = 0; j < last; j++) {
+        auto& cl = stk.closest[j];
+        const auto qx = dataon[j].xs();
+        const auto qy = dataon[j].ys();
+        const int np_end = qx.size();
+        for (int k = 0; k < np_end; k++) {
+            const float dis = (qx[k] - p.x) * (qx[k] - p.x) + (qy[k] - p.y) * (qy[k] - p.y);
+            if (dis < cl.d2 || (dis == cl.d2 && k < cl.pj))
+                cl = { dis, np, k };
+        }
+    }
+}
+
+// Closest pair between the points of a whole stroke and another one. As the ties are broken
+// by the index in the other stroke and then in this one, each point of this stroke can keep
+// its own minimum: the inner loop has no dependencies between iterations and is vectorized
+static Closest closestPair(const Stroke& stk, const Stroke& other, std::vector<float>& best, std::vector<int>& arg)
+{
+    const float* px = stk.xs().data();
+    const float* py = stk.ys().data();
+    const int np = stk.getNPoints();
+    const auto qx = other.xs();
+    const auto qy = other.ys();
+
+    best.assign(np, FLT_MAX);
+    arg.assign(np, -1);
+    float* bd = best.data();
+    int* bk = arg.data();
+    for (int k = 0; k < (int)qx.size(); k++) {
+        const float x = qx[k], y = qy[k];
+        for (int i = 0; i < np; i++) {
+            const float dis = (x - px[i]) * (x - px[i]) + (y - py[i]) * (y - py[i]);
+            const bool closer = dis < bd[i];
+            bd[i] = closer ? dis : bd[i];
+            bk[i] = closer ? k : bk[i];
+        }
+    }
+
+    Closest cl = { FLT_MAX, -1, -1 };
+    for (int i = 0; i < np; i++)
+        if (bd[i] < cl.d2 || (bd[i] == cl.d2 && bk[i] < cl.pj))
+            cl = { bd[i], i, bk[i] };
+    return cl;
+}
+
+void Samples::addPoint(const Point& p)
+{
+    const auto capacity = xs.capacity();
+    xs.push_back(p.x);
+    ys.push_back(p.y);
+    if (xs.capacity() != capacity)
+        rebase();
+
+    auto& stk = dataon.back();
+    const int np = stk.getNPoints();
+    stk.add(p);
+    updateClosest(np, p);
+}
+
+void Samples::addPoints(std::span<const Point> pts)
+{
+    for (const auto& p : pts)
+        addPoint(p);
+}
+
+void Samples::copyStroke(std::span<const Point> pts)
+{
+    const std::size_t first = xs.size();
+    const auto capacity = xs.capacity();
+    for (const auto& p : pts) {
+        xs.push_back(p.x);
+        ys.push_back(p.y);
+    }
+    if (xs.capacity() != capacity)
+        rebase();
+
+    borrowStroke(std::span(xs).subspan(first), std::span(ys).subspan(first));
+}
+
+void Samples::borrowStroke(std::span<const float> x, std::span<const float> y)
+{
+    beginStroke();
+    auto& stk = dataon.back();
+    stk.borrow(x, y);
+
+    std::vector<float> best;
+    std::vector<int> arg;
+    for (int j = 0; j < nStrokes() - 1; j++)
+        stk.closest[j] = closestPair(stk, dataon[j], best, arg);
+}
+
+void Samples::endStroke()
+{
+    for (; nfinished < nStrokes(); nfinished++)
+        dataon[nfinished].finish();
+}
+
+void Samples::removeStroke()
+{
+    xs.resize(xs.size() - dataon.back().np);
+    ys.resize(ys.size() - dataon.back().np);
+    dataon.pop_back();
+    nfinished = std::min(nfinished, nStrokes());
+}
+
 void Samples::makeReady()
 {
+    endStroke();
+
     ox = INT_MAX;
     oy = INT_MAX;
     os = -INT_MAX;
     ot = -INT_MAX;
-    for (auto& datapoint : dataon) {
+    for (const auto& datapoint : dataon) {
         // Compute bouding box
         if (datapoint.rx < ox)
             ox = datapoint.rx;
@@ -82,18 +216,6 @@ void Samples::makeReady()
             os = datapoint.rs;
         if (datapoint.rt > ot)
             ot = datapoint.rt;
-
-        // Compute centroid
-        datapoint.cx = 0;
-        datapoint.cy = 0;
-        const int np_end = datapoint.getNPoints();
-        for (int np = 0; np < np_end; np++) {
-            Point* pto = datapoint.get(np);
-            datapoint.cx += pto->x;
-            datapoint.cy += pto->y;
-        }
-        datapoint.cx /= np_end;
-        datapoint.cy /= np_end;
     }
 
     RX = 0;
@@ -147,18 +269,22 @@ void Samples::render_img(const char* out)
 
 void Samples::detRefSymbol()
 {
-    vmedx.clear();
-    vmedy.clear();
+    std::tie(RX, RY) = refSymbol(dataon);
+}
 
+// Reference symbol size (width, height) for normalization
+std::pair<int, int> Samples::refSymbol(std::span<const Stroke> strokes)
+{
+    std::vector<int> vmedx, vmedy;
     int nregs = 0, lAr;
     float mAr = 0;
-    RX = 0, RY = 0;
+    int RX = 0, RY = 0;
 
-    const int numStrk = nStrokes();
+    const int numStrk = strokes.size();
     // Compute reference symbol for normalization
     for (int i = 0; i < numStrk; i++) {
-        int ancho = dataon[i].rs - dataon[i].rx + 1;
-        int alto = dataon[i].rt - dataon[i].ry + 1;
+        int ancho = strokes[i].rs - strokes[i].rx + 1;
+        int alto = strokes[i].rt - strokes[i].ry + 1;
         float aspectratio = (float)ancho / alto;
         int area = ancho * alto;
 
@@ -183,8 +309,8 @@ void Samples::detRefSymbol()
         RY /= nregs;
     } else {
         for (int i = 0; i < numStrk; i++) {
-            int ancho = dataon[i].rs - dataon[i].rx + 1;
-            int alto = dataon[i].rt - dataon[i].ry + 1;
+            int ancho = strokes[i].rs - strokes[i].rx + 1;
+            int alto = strokes[i].rt - strokes[i].ry + 1;
 
             RX += ancho;
             RY += alto;
@@ -201,6 +327,8 @@ void Samples::detRefSymbol()
     // Reference is the average of (mean,median,avg_area)
     RX = (RX + vmedx[vmedx.size() / 2] + lAr) / 3.0;
     RY = (RY + vmedy[vmedy.size() / 2] + lAr) / 3.0;
+
+    return { RX, RY };
 }
 
 void Samples::setRegion(CellCYK& c, int nStk)
@@ -276,23 +404,8 @@ void Samples::linea_pbm(VectorImage& img, Point* pa, Point* pb, int stkid)
 
 void Samples::render()
 {
-    int xMAX = -INT_MAX, yMAX = -INT_MAX, xMIN = INT_MAX, yMIN = INT_MAX;
-
-    for (const auto& data_on_point : dataon) {
-        const int np_end = data_on_point.getNPoints();
-        for (int np = 0; np < np_end; np++) {
-            const Point* pto = data_on_point.get(np);
-
-            if (pto->x > xMAX)
-                xMAX = pto->x;
-            if (pto->x < xMIN)
-                xMIN = pto->x;
-            if (pto->y > yMAX)
-                yMAX = pto->y;
-            if (pto->y < yMIN)
-                yMIN = pto->y;
-        }
-    }
+    // Bounding box of the sample, from the per-stroke ones (makeReady)
+    const int xMAX = os, yMAX = ot, xMIN = ox, yMIN = oy;
 
     // Image dimensions
     int W = xMAX - xMIN + 1;
@@ -314,7 +427,7 @@ void Samples::render()
     auto& img = dataoff;
     img.height = H;
     img.width = W;
-    img.img.resize(W * H, 255);
+    img.img.assign(W * H, 255);
 
     // Create the structure that stores to which stroke belongs each pixel
     pix_stk.height = H;
@@ -323,14 +436,14 @@ void Samples::render()
     pix_stk.img.resize(W * H, -1);
 
     // Render image
-    Point pant, aux, *pto;
+    Point pant, aux, pto;
     for (int i = 0; i < nStrokes(); i++) {
 
         for (int np = 0; np < dataon[i].getNPoints(); np++) {
             pto = dataon[i].get(np);
 
-            aux.x = 5 + (W - 10) * (float)(pto->x - xMIN) / (xMAX - xMIN + 1);
-            aux.y = 5 + (H - 10) * (float)(pto->y - yMIN) / (yMAX - yMIN + 1);
+            aux.x = 5 + (W - 10) * (float)(pto.x - xMIN) / (xMAX - xMIN + 1);
+            aux.y = 5 + (H - 10) * (float)(pto.y - yMIN) / (yMAX - yMIN + 1);
 
             img.img[(int)aux.y * W + (int)aux.x] = 0;
             pix_stk.img[(int)aux.y * W + (int)aux.x] = i;
@@ -364,20 +477,11 @@ void Samples::renderStrokesPBM(std::span<const int> SL, VectorImage& img)
 
     // Calculate bounding box of the region defined by the points
     for (const auto it : SL) {
-        const auto& datapt = dataon[it];
-        const auto nPoints = datapt.getNPoints();
-        for (int i = 0; i < nPoints; i++) {
-            const Point* p = datapt.get(i);
-
-            if (p->x < xMin)
-                xMin = p->x;
-            if (p->y < yMin)
-                yMin = p->y;
-            if (p->x > xMax)
-                xMax = p->x;
-            if (p->y > yMax)
-                yMax = p->y;
-        }
+        const auto& stk = dataon[it];
+        xMin = std::min(xMin, stk.rx);
+        yMin = std::min(yMin, stk.ry);
+        xMax = std::max(xMax, stk.rs);
+        yMax = std::max(yMax, stk.rt);
     }
 
     // Image dimensions
@@ -416,10 +520,10 @@ void Samples::renderStrokesPBM(std::span<const int> SL, VectorImage& img)
             const auto& datapt = dataon[it];
             const auto nPoints = datapt.getNPoints();
             for (int i = 0; i < nPoints; i++) {
-                const Point* p = datapt.get(i);
+                const Point p = datapt.get(i);
 
-                aux.x = OFFSET + (W - 1) * (p->x - xMin) / (float)(xMax - xMin + 1);
-                aux.y = OFFSET + (H - 1) * (p->y - yMin) / (float)(yMax - yMin + 1);
+                aux.x = OFFSET + (W - 1) * (p.x - xMin) / (float)(xMax - xMin + 1);
+                aux.y = OFFSET + (H - 1) * (p.y - yMin) / (float)(yMax - yMin + 1);
 
                 img.img[(int)aux.y * img.width + (int)aux.x] = 0;
 
@@ -467,20 +571,11 @@ void Samples::getCentroids(CellCYK* cd, int* ce, int* as, int* ds)
     *ce = 0;
 
     for (int i = 0; i < cd->nc; i++)
-        if (cd->ccc[i]) {
-
-            for (int j = 0; j < dataon[i].getNPoints(); j++) {
-                Point* p = dataon[i].get(j);
-
-                if (dataon[i].ry < regy)
-                    regy = dataon[i].ry;
-                if (dataon[i].rt > regt)
-                    regt = dataon[i].rt;
-
-                *ce += p->y;
-
-                N++;
-            }
+        if (cd->ccc[i] && dataon[i].np) {
+            regy = std::min(regy, dataon[i].ry);
+            regt = std::max(regt, dataon[i].rt);
+            *ce += dataon[i].sy;
+            N += dataon[i].np;
         }
 
     *ce /= N;
@@ -493,7 +588,7 @@ void Samples::compute_strokes_distances(int rx, int ry)
     // Create distances matrix NxN (strokes)
     stk_dis.width = nStrokes();
     stk_dis.height = nStrokes();
-    stk_dis.img.resize(stk_dis.width * stk_dis.height, 0.0f);
+    stk_dis.img.assign(stk_dis.width * stk_dis.height, 0.0f);
 
     float aux_x = rx;
     float aux_y = ry;
@@ -512,29 +607,25 @@ void Samples::compute_strokes_distances(int rx, int ry)
 
 float Samples::stroke_distance(int si, int sj)
 {
-    Point *pi, *pj, *min_i, *min_j;
-    float dmin = FLT_MAX;
+    if (si > sj)
+        std::swap(si, sj);
 
-    for (int npi = 0; npi < dataon[si].getNPoints(); npi++) {
-        pi = dataon[si].get(npi);
+    // Closest points were found while adding the points of sj
+    const Closest& cl = dataon[sj].closest[si];
+    if (cl.d2 == FLT_MAX)
+        return FLT_MAX;
 
-        for (int npj = 0; npj < dataon[sj].getNPoints(); npj++) {
-            pj = dataon[sj].get(npj);
+    if (not_visible(si, sj, dataon[si].get(cl.pj), dataon[sj].get(cl.pi)))
+        return FLT_MAX;
 
-            float dis = (pi->x - pj->x) * (pi->x - pj->x) + (pi->y - pj->y) * (pi->y - pj->y);
-
-            if (dis < dmin) {
-                dmin = dis;
-                min_i = pi;
-                min_j = pj;
-            }
-        }
-    }
-
-    if (not_visible(si, sj, min_i, min_j))
-        dmin = FLT_MAX;
+    return sqrt(cl.d2);
+}
 
-    return dmin < FLT_MAX ? sqrt(dmin) : FLT_MAX;
+float Samples::min_dist(int si, int sj)
+{
+    if (si > sj)
+        std::swap(si, sj);
+    return sqrt(dataon[sj].closest[si].d2);
 }
 
 float Samples::getDist(int si, int sj)
@@ -549,15 +640,15 @@ float Samples::getDist(int si, int sj)
 // Go through the pixels from pi to pj checking that there is not a pixel that belongs
 // to a stroke that is not si or sj. If so, then sj is not visible from si
 
-bool Samples::not_visible(int si, int sj, Point* pi, Point* pj)
+bool Samples::not_visible(int si, int sj, const Point& pi, const Point& pj)
 {
 
     Point pa, pb;
     // Coordinates in pixels of the rendered image
-    pa.x = 5 + (dataoff.width - 10) * (float)(pi->x - IMGxMIN) / (IMGxMAX - IMGxMIN + 1);
-    pa.y = 5 + (dataoff.height - 10) * (float)(pi->y - IMGyMIN) / (IMGyMAX - IMGyMIN + 1);
-    pb.x = 5 + (dataoff.width - 10) * (float)(pj->x - IMGxMIN) / (IMGxMAX - IMGxMIN + 1);
-    pb.y = 5 + (dataoff.height - 10) * (float)(pj->y - IMGyMIN) / (IMGyMAX - IMGyMIN + 1);
+    pa.x = 5 + (dataoff.width - 10) * (float)(pi.x - IMGxMIN) / (IMGxMAX - IMGxMIN + 1);
+    pa.y = 5 + (dataoff.height - 10) * (float)(pi.y - IMGyMIN) / (IMGyMAX - IMGyMIN + 1);
+    pb.x = 5 + (dataoff.width - 10) * (float)(pj.x - IMGxMIN) / (IMGxMAX - IMGxMIN + 1);
+    pb.y = 5 + (dataoff.height - 10) * (float)(pj.y - IMGyMIN) / (IMGyMAX - IMGyMIN + 1);
 
     const float dl = 3.125e-4;
     int dx = (int)pb.x - (int)pa.x;
@@ -620,29 +711,3 @@ float Samples::group_penalty(CellCYK* A, CellCYK* B)
 
     return dmin;
 }
-
-void Samples::get_close_strokes(int id, std::vector<int>& L, float dist_th)
-{
-    std::vector<int> to_maybe_add(id);
-    std::iota(to_maybe_add.begin(), to_maybe_add.end(), 0); // all currently possible
-
-    // Add linked strokes with distance < dist_th
-    for (auto& i : to_maybe_add) {
-        if (getDist(id, i) >= dist_th)
-            continue;
-
-        L.push_back(i);
-        i = -1;
-    }
-
-    // Add second degree distance < dist_th
-    for (int it = 0, itend = L.size(); it < itend; ++it) {
-        for (auto& i : to_maybe_add) {
-            if (i < 0 || getDist(L[it], i) >= dist_th)
-                continue;
-
-            L.push_back(i);
-            i = -1; // mark as unusable for next loop
-        }
-    }
-}
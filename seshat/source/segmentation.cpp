@@ -32,16 +32,11 @@ SegmentationModelGMM::SegmentationModelGMM(const fs::path& mod)
     model.emplace(fd);
 }
 
-float SegmentationModelGMM::prob(CellCYK* cd, Samples* m)
+float SegmentationModelGMM::prob(std::span<const int> strokes_list, Samples* m)
 {
     int nps = 0;
     float dist = 0, delta = 0, sigma = 0, mind = 0, avgsize = 0;
 
-    strokes_list.clear();
-    for (int i = 0; i < cd->nc; i++)
-        if (cd->ccc[i])
-            strokes_list.push_back(i);
-
     const int Nstrokes = strokes_list.size();
     // For every stroke
     for (int i = 0; i < Nstrokes; i++) {
@@ -54,7 +49,7 @@ float SegmentationModelGMM::prob(CellCYK* cd, Samples* m)
             Stroke& Sj = m->getStroke(strokes_list[j]);
 
             // distance between stroke Si and Sj
-            mind += Si.min_dist(&Sj);
+            mind += m->min_dist(strokes_list[i], strokes_list[j]);
 
             dist += abs((Si.rs + Si.rx) / 2.0 - (Sj.rs + Sj.rx) / 2.0);
             sigma += abs((Si.rt + Si.ry) / 2.0 - (Sj.rt + Sj.ry) / 2.0);
@@ -16,23 +16,140 @@
     along with SESHAT.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <checkpoints.hpp>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iostream>
 #include <meparser.hpp>
+#include <mutex>
+#include <numeric>
+#include <page.hpp>
 #include <samples.hpp>
 #include <seshat/seshat.hpp>
+#include <stdexcept>
+#include <thread>
 
 using namespace seshat;
 
+struct math_expression::worker {
+    std::unique_ptr<meParser> parser;
+    Samples samples;
+};
+
 math_expression::math_expression(const char* config_path)
     : parser{ std::make_unique<meParser>(config_path) }
     , samples{ std::make_unique<Samples>() }
+    , ink{ std::make_unique<Samples>() }
+    , checkpoints{ std::make_unique<Checkpoints>(8 << 20) }
+    , config{ config_path }
 {
 }
 
 math_expression::~math_expression() = default;
 
+// Apply a setting to every parser, now and when a worker is created
+void math_expression::configure(std::string_view name, std::function<void(meParser&)> setting)
+{
+    setting(*parser);
+    for (const auto& w : workers)
+        if (w)
+            setting(*w->parser);
+
+    // Workers created later only need the latest value
+    const auto same = std::find_if(settings.begin(), settings.end(), [&](const auto& s) { return s.first == name; });
+    if (same != settings.end())
+        same->second = std::move(setting);
+    else
+        settings.emplace_back(name, std::move(setting));
+}
+
 void math_expression::want_max_hypothesis(unsigned amount)
 {
-    parser->setMaxHypothesis(amount);
+    configure("max_hypothesis", [=](meParser& p) { p.setMaxHypothesis(amount); });
+    checkpoints->clear();
+}
+
+void math_expression::want_concurrent_classifiers(bool enable, executor exec)
+{
+    configure("concurrent_classifiers", [=](meParser& p) { p.setConcurrentClassifiers(enable, exec); });
+}
+
+void math_expression::want_classifier_cascade(float top, float margin, bool audit)
+{
+    configure("classifier_cascade", [=](meParser& p) { p.setClassifierCascade(top, margin, audit); });
+    checkpoints->clear();
+}
+
+void math_expression::want_symbols(const std::vector<std::string>& symbols)
+{
+    configure("symbols", [=](meParser& p) { p.setVocabulary(symbols); });
+    checkpoints->clear();
+}
+
+void math_expression::want_segment_pruning(float min_prob, float min_score)
+{
+    configure("segment_pruning", [=](meParser& p) { p.setSegmentPruning(min_prob, min_score); });
+    checkpoints->clear();
+}
+
+void math_expression::want_checkpoints(std::size_t max_bytes)
+{
+    checkpoints->setLimit(max_bytes);
+}
+
+void math_expression::want_best_first(bool enable, std::size_t max_items)
+{
+    configure("best_first", [=](meParser& p) { p.setBestFirst(enable, max_items); });
+    checkpoints->clear();
+}
+
+void math_expression::want_search_windows(const search_windows& windows)
+{
+    configure("search_windows", [=](meParser& p) { p.setSearchWindows(windows); });
+    checkpoints->clear();
+}
+
+void math_expression::want_latency_target(std::chrono::nanoseconds target)
+{
+    configure("latency_target", [=](meParser& p) { p.setLatencyTarget(target); });
+}
+
+parse_effort math_expression::last_effort() const
+{
+    return effort;
+}
+
+search_windows math_expression::calibrate_search_windows(std::span<const sample> corpus, float quantile)
+{
+    WindowCalibration calibration;
+    std::vector<hypothesis> output;
+    parser->setCalibration(&calibration);
+    try {
+        for (const auto& input : corpus) {
+            if (input.strokes.empty())
+                continue;
+            load_sample(*samples, input);
+            output.clear();
+            parser->parse_me(*samples, output);
+        }
+    } catch (...) {
+        parser->setCalibration(nullptr);
+        throw;
+    }
+    parser->setCalibration(nullptr);
+
+    return calibration.windows(parser->getSearchWindows(), quantile);
+}
+
+const statistics& math_expression::get_statistics() const
+{
+    return parser->getStatistics();
+}
+
+void math_expression::reset_statistics()
+{
+    parser->resetStatistics();
 }
 
 std::vector<hypothesis> math_expression::parse_sample(const sample& input)
@@ -42,28 +159,274 @@ std::vector<hypothesis> math_expression::parse_sample(const sample& input)
     return output;
 }
 
-void math_expression::parse_sample(const sample& input, std::vector<hypothesis>& output)
+void math_expression::load_sample(const sample& input)
+{
+    load_sample(*samples, input);
+}
+
+void math_expression::load_sample(Samples& into, const sample& input)
 {
-    samples->clearAll();
+    into.clearAll();
+
+    std::size_t total = 0;
+    for (const auto& input_stroke : input.strokes)
+        total += input_stroke.points.size();
+    into.xs.reserve(total);
+    into.ys.reserve(total);
 
     for (const auto& input_stroke : input.strokes) {
-        auto& output_stroke = samples->dataon.emplace_back();
-        output_stroke.pseq.reserve(input_stroke.points.size());
-
-        for (const auto& input_point : input_stroke.points) {
-            output_stroke.pseq.push_back(input_point);
-            if (input_point.x < output_stroke.rx)
-                output_stroke.rx = input_point.x;
-            if (input_point.y < output_stroke.ry)
-                output_stroke.ry = input_point.y;
-            if (input_point.x > output_stroke.rs)
-                output_stroke.rs = input_point.x;
-            if (input_point.y > output_stroke.rt)
-                output_stroke.rt = input_point.y;
-        }
+        into.copyStroke(input_stroke.points);
     }
 
-    samples->makeReady();
+    into.makeReady();
+}
+
+void math_expression::load_sample(Samples& into, const sample_view& input)
+{
+    into.clearAll();
+
+    for (std::size_t k = 0; k < input.size(); k++) {
+        into.borrowStroke(input.stroke_x(k), input.stroke_y(k));
+    }
 
+    into.makeReady();
+}
+
+void math_expression::parse_sample(const sample& input, std::vector<hypothesis>& output)
+{
+    load_sample(input);
+    parser->parse_me(*samples, output);
+    effort = parser->getEffort();
+}
+
+void math_expression::parse_sample(const sample& input, forest& output)
+{
+    load_sample(input);
+    parser->parse_me(*samples, output);
+    effort = parser->getEffort();
+}
+
+void math_expression::parse_sample(const sample_view& input, std::vector<hypothesis>& output)
+{
+    load_sample(*samples, input);
     parser->parse_me(*samples, output);
+    effort = parser->getEffort();
+}
+
+parse_status math_expression::parse_sample(const sample& input, std::vector<hypothesis>& output, std::stop_token stop)
+{
+    load_sample(input);
+    const bool complete = parser->parse_me(*samples, output, { .stop = std::move(stop) });
+    effort = parser->getEffort();
+    return complete ? parse_status::complete : parse_status::partial;
+}
+
+parse_status math_expression::parse_sample(const sample& input, std::vector<hypothesis>& output, std::chrono::steady_clock::time_point deadline)
+{
+    load_sample(input);
+    const bool complete = parser->parse_me(*samples, output, { .stop = {}, .deadline = deadline });
+    effort = parser->getEffort();
+    return complete ? parse_status::complete : parse_status::partial;
+}
+
+void math_expression::begin_stroke()
+{
+    ink->endStroke();
+    ink->beginStroke();
+}
+
+void math_expression::add_points(std::span<const point> pts)
+{
+    if (ink->nfinished == ink->nStrokes()) {
+        std::cerr << "Error: points added outside of a stroke\n";
+        throw std::runtime_error("Error: points added outside of a stroke");
+    }
+    ink->addPoints(pts);
+}
+
+void math_expression::end_stroke()
+{
+    ink->endStroke();
+}
+
+void math_expression::remove_last_stroke()
+{
+    if (ink->nStrokes()) {
+        ink->removeStroke();
+        checkpoints->truncate(ink->nStrokes());
+    }
+}
+
+void math_expression::clear_strokes()
+{
+    ink->clearAll();
+    checkpoints->clear();
+}
+
+std::size_t math_expression::stroke_count() const
+{
+    return ink->dataon.size();
+}
+
+void math_expression::parse_strokes(std::vector<hypothesis>& output)
+{
+    parse_strokes(output, {});
+}
+
+parse_status math_expression::parse_strokes(std::vector<hypothesis>& output, std::stop_token stop)
+{
+    if (!ink->nStrokes())
+        return parse_status::complete;
+    ink->makeReady();
+
+    // The same strokes were parsed before (e.g. the last ones were removed since)
+    if (const auto hyps = checkpoints->result(ink->nStrokes())) {
+        output.insert(output.end(), hyps->begin(), hyps->end());
+        effort = parse_effort::full;
+        return parse_status::complete;
+    }
+
+    // Only full effort results are kept, a later parse may have more time for them
+    const std::size_t first = output.size();
+    const bool complete = parser->parse_me(*ink, output, { .stop = std::move(stop) }, checkpoints.get());
+    effort = parser->getEffort();
+    if (!complete)
+        return parse_status::partial;
+    if (effort == parse_effort::full)
+        checkpoints->store(ink->nStrokes(), { output.begin() + first, output.end() });
+    return parse_status::complete;
+}
+
+std::vector<std::vector<hypothesis>> math_expression::parse_batch(std::span<const sample> inputs, unsigned threads, std::span<std::chrono::nanoseconds> times)
+{
+    return parse_many(
+        inputs.size(), [&](std::size_t i) { return inputs[i].strokes.size(); },
+        [&](Samples& M, std::size_t i) { load_sample(M, inputs[i]); }, threads, times);
+}
+
+std::vector<std::vector<hypothesis>> math_expression::parse_batch(std::span<const sample_view> inputs, unsigned threads, std::span<std::chrono::nanoseconds> times)
+{
+    return parse_many(
+        inputs.size(), [&](std::size_t i) { return inputs[i].size(); },
+        [&](Samples& M, std::size_t i) { load_sample(M, inputs[i]); }, threads, times);
+}
+
+void math_expression::want_page_gaps(float horizontal, float vertical)
+{
+    page_hgap = horizontal;
+    page_vgap = vertical;
+}
+
+std::vector<page_region> math_expression::parse_page(const sample& page, unsigned threads)
+{
+    // Only the per-stroke bounding boxes are needed to split the page
+    std::vector<Stroke> strokes(page.strokes.size());
+    for (std::size_t k = 0; k < strokes.size(); k++)
+        for (const auto& p : page.strokes[k].points)
+            strokes[k].include({ p.x, p.y });
+
+    const auto regions = segmentPage(strokes, page_hgap, page_vgap);
+    auto results = parse_many(
+        regions.size(), [&](std::size_t i) { return regions[i].strokes.size(); },
+        [&](Samples& M, std::size_t i) {
+            M.clearAll();
+            for (const int k : regions[i].strokes)
+                M.copyStroke(page.strokes[k].points);
+            M.makeReady();
+        },
+        threads, {});
+
+    std::vector<page_region> output(regions.size());
+    for (std::size_t i = 0; i < regions.size(); i++) {
+        const auto& reg = regions[i];
+        output[i].strokes.assign(reg.strokes.begin(), reg.strokes.end());
+        output[i].x = reg.rx;
+        output[i].y = reg.ry;
+        output[i].s = reg.rs;
+        output[i].t = reg.rt;
+        output[i].hypotheses = std::move(results[i]);
+    }
+    return output;
+}
+
+// Parse `count` samples over several threads, largest first
+std::vector<std::vector<hypothesis>> math_expression::parse_many(std::size_t count, const std::function<std::size_t(std::size_t)>& strokes, const std::function<void(Samples&, std::size_t)>& load, unsigned threads, std::span<std::chrono::nanoseconds> times)
+{
+    if (!times.empty() && times.size() != count) {
+        std::cerr << "Error: parse_batch needs one time per input\n";
+        throw std::runtime_error("Error: parse_batch needs one time per input");
+    }
+
+    std::vector<std::vector<hypothesis>> output(count);
+    if (!count)
+        return output;
+
+    if (!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<std::size_t>(threads, count);
+    if (workers.size() < threads - 1)
+        workers.resize(threads - 1);
+
+    // Longest first, so that no thread is left with a large sample at the end
+    std::vector<std::size_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+        return strokes(a) > strokes(b);
+    });
+
+    std::atomic<std::size_t> next{ 0 };
+    std::mutex error_mtx;
+    std::exception_ptr error;
+
+    const auto run = [&](meParser& p, Samples& M) {
+        try {
+            for (std::size_t i; (i = next++) < order.size();) {
+                if (!strokes(order[i]))
+                    continue;
+                const auto start = std::chrono::steady_clock::now();
+                load(M, order[i]);
+                p.parse_me(M, output[order[i]]);
+                if (!times.empty())
+                    times[order[i]] = std::chrono::steady_clock::now() - start;
+            }
+        } catch (...) {
+            std::lock_guard lock(error_mtx);
+            if (!error)
+                error = std::current_exception();
+            next = order.size();
+        }
+    };
+
+    {
+        std::vector<std::jthread> pool;
+        for (unsigned t = 0; t + 1 < threads; ++t) {
+            pool.emplace_back([&, t] {
+                auto& w = workers[t];
+                try {
+                    if (!w) {
+                        w = std::make_unique<worker>();
+                        w->parser = std::make_unique<meParser>(config);
+                        for (const auto& [name, setting] : settings)
+                            setting(*w->parser);
+                    }
+                } catch (...) {
+                    std::lock_guard lock(error_mtx);
+                    if (!error)
+                        error = std::current_exception();
+                    w.reset();
+                    return;
+                }
+                run(*w->parser, w->samples);
+            });
+        }
+        run(*parser, *samples);
+    }
+
+    for (const auto& w : workers)
+        if (w)
+            parser->mergeStatistics(*w->parser);
+
+    if (error)
+        std::rethrow_exception(error);
+    return output;
 }
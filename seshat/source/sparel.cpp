@@ -30,28 +30,6 @@ using namespace seshat;
 
 // Aux functions
 
-InternalHypothesis* leftmost(InternalHypothesis* h)
-{
-    if (h->pt)
-        return h;
-
-    InternalHypothesis* izq = leftmost(h->hi);
-    InternalHypothesis* der = leftmost(h->hd);
-
-    return izq->parent->x < der->parent->x ? izq : der;
-}
-
-InternalHypothesis* rightmost(InternalHypothesis* h)
-{
-    if (h->pt)
-        return h;
-
-    InternalHypothesis* izq = rightmost(h->hi);
-    InternalHypothesis* der = rightmost(h->hd);
-
-    return izq->parent->s > der->parent->s ? izq : der;
-}
-
 // Percentage of the area of region A that overlaps with region B
 float solape(CellCYK* a, CellCYK* b)
 {
@@ -74,9 +52,10 @@ float solape(CellCYK* a, CellCYK* b)
 // SpaRel methods
 //
 
-SpaRel::SpaRel(GMM& gmm, Samples& m)
+SpaRel::SpaRel(GMM& gmm, Samples& m, std::size_t& scored)
     : model{ gmm }
     , mue{ m }
+    , scored{ scored }
 {
 }
 
@@ -109,10 +88,8 @@ double SpaRel::compute_prob(InternalHypothesis* h1, InternalHypothesis* h2, int
 
     if (k <= 2) {
         // Check left-to-right order constraint in Hor/Sub/Sup relationships
-        InternalHypothesis* rma = rightmost(h1);
-        InternalHypothesis* lmb = leftmost(h2);
-
-        if (lmb->parent->x < rma->parent->x || lmb->parent->s <= rma->parent->s)
+        // between the rightmost terminal of h1 and the leftmost terminal of h2
+        if (h2->lx < h1->rx || h2->ls <= h1->rs)
             return 0.0;
     }
 
@@ -123,6 +100,7 @@ double SpaRel::compute_prob(InternalHypothesis* h1, InternalHypothesis* h2, int
 
     // Get spatial relationships probability from the model
     model.posterior(sample, probs);
+    ++scored;
 
     // Slightly smooth probabilities because GMM classifier can provide
     // to biased probabilities. Thsi way we give some room to the
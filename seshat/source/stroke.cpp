@@ -31,40 +31,73 @@ bool esNum(char c)
 
 Stroke::Stroke()
 {
+    px = py = nullptr;
+    np = 0;
+    sx = sy = 0;
     cx = cy = 0;
     rx = ry = INT_MAX;
     rs = rt = -INT_MAX;
 }
 
-Point* Stroke::get(int idx)
+void Stroke::include(const Point& p)
 {
-    return &pseq[idx];
+    sx += p.x;
+    sy += p.y;
+
+    if (p.x < rx)
+        rx = p.x;
+    if (p.y < ry)
+        ry = p.y;
+    if (p.x > rs)
+        rs = p.x;
+    if (p.y > rt)
+        rt = p.y;
 }
 
-const Point* Stroke::get(int idx) const
+void Stroke::borrow(std::span<const float> xs, std::span<const float> ys)
 {
-    return &pseq[idx];
+    px = xs.data();
+    py = ys.data();
+    np = (int)xs.size();
+    for (int i = 0; i < np; i++)
+        include({ xs[i], ys[i] });
 }
 
-int Stroke::getNPoints() const
+void Stroke::add(const Point& p)
 {
-    return (int)pseq.size();
+    np++;
+    include(p);
 }
 
-float Stroke::min_dist(Stroke* st)
+void Stroke::finish()
 {
-    float mind = FLT_MAX;
-    for (int i = 0; i < (int)pseq.size(); i++) {
-        for (int j = 0; j < st->getNPoints(); j++) {
-            Point* p = st->get(j);
+    if (np) {
+        cx = sx / np;
+        cy = sy / np;
+    }
 
-            float d = (pseq[i].x - p->x) * (pseq[i].x - p->x)
-                + (pseq[i].y - p->y) * (pseq[i].y - p->y);
+    // Remove repeated points & Median filter, as done for every segment using this stroke
+    // (sentence::no_repeats().smoothed()), straight from the points without a copy
+    std::vector<sent_point> norep;
+    norep.reserve(np);
+    for (int i = 0; i < np; i++) {
+        const Point p = get(i);
+        const sent_point pt(p.x, p.y);
+        if (norep.empty() || pt != norep.back())
+            norep.push_back(pt);
+    }
 
-            if (d < mind)
-                mind = d;
+    constexpr int cont_size = 2;
+    const int n = (int)norep.size();
+    filtered.clear();
+    filtered.reserve(n);
+    for (int p = 0; p < n; p++) {
+        int sum_x = 0, sum_y = 0;
+        for (int c = p - cont_size; c <= p + cont_size; c++) {
+            const int pt_idx = std::clamp(c, 0, n - 1);
+            sum_x += norep[pt_idx].x;
+            sum_y += norep[pt_idx].y;
         }
+        filtered.emplace_back(int(sum_x / (cont_size * 2 + 1)), int(sum_y / (cont_size * 2 + 1)));
     }
-
-    return sqrt(mind);
 }
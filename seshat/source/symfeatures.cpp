@@ -62,22 +62,17 @@ std::unique_ptr<DataSequence> SymFeatures::getOnline(Samples& M, SegmentHyp& Seg
     // Create and fill sequence of points
     sentence sent(SegHyp.stks.size());
 
+    // Repeated points were removed and the median filter applied once per stroke
     for (const auto it_idx : SegHyp.stks) {
         const auto& cur_stroke = M.getStroke(it_idx);
-        auto& st = sent.strokes.emplace_back(cur_stroke.getNPoints(), 1); // means is pendown stroke
-
-        for (int j = 0; j < st.n_points; j++) {
-            const Point* p = cur_stroke.get(j);
-            st.points.emplace_back(p->x, p->y);
-        }
+        auto& st = sent.strokes.emplace_back(0, 1); // means is pendown stroke
+        st.points = cur_stroke.filtered;
+        st.n_points = st.points.size();
     }
 
-    // Remove repeated points & Median filter
-    const sentence sent_filt = sent.no_repeats().smoothed();
-
     // Compute online features
     sentenceF feat;
-    feat.calculate_features(sent_filt);
+    feat.calculate_features(sent);
 
     // Create DataSequence
 
@@ -36,7 +36,13 @@ using namespace seshat;
 
 #define TSIZE 2048
 
-SymRec::SymRec(const fs::path& config)
+SymRec::SymRec(const fs::path& config, statistics& st)
+    : restricted{ false }
+    , concurrent{ false }
+    , cascadeTH{ -1 }
+    , cascadeMargin{ -1 }
+    , cascadeAudit{ false }
+    , stats{ st }
 {
     // RNN classifier configuration
     std::string RNNon, RNNoff, RNNmavON, RNNmavOFF, path;
@@ -64,6 +70,10 @@ SymRec::SymRec(const fs::path& config)
 
             if (id == "RNNalpha") {
                 fd >> RNNalpha >> std::ws;
+            } else if (id == "RNNcascadeTH") {
+                fd >> cascadeTH >> std::ws;
+            } else if (id == "RNNcascadeMargin") {
+                fd >> cascadeMargin >> std::ws;
             } else {
                 for (auto& [key, into] : which) {
                     if (id == key) {
@@ -150,6 +160,12 @@ SymRec::SymRec(const fs::path& config)
     header_on.outputSize = header_on.targetLabels.size();
     header_on.numDims = 1;
 
+    // Resolve the class id of every network output once
+    label2key.reserve(header_on.targetLabels.size());
+    for (const auto& label : header_on.targetLabels)
+        label2key.push_back(keyClase(label));
+    setVocabulary({});
+
     // Create WeightContainer online
     wc_on = std::make_unique<WeightContainer>(&deh_on);
 
@@ -240,6 +256,53 @@ SymbolType SymRec::symType(int k)
     return type[k];
 }
 
+void SymRec::setConcurrent(bool enable, executor ex)
+{
+    concurrent = enable;
+    exec = std::move(ex);
+}
+
+void SymRec::setCascade(float top, float margin, bool audit)
+{
+    cascadeTH = top;
+    cascadeMargin = margin;
+    cascadeAudit = audit;
+}
+
+void SymRec::setVocabulary(const std::vector<bool>& clases)
+{
+    restricted = false;
+    activeLabels.clear();
+    for (int i = 0; i < (int)label2key.size(); i++) {
+        if (clases.empty() || (label2key[i] >= 0 && clases[label2key[i]]))
+            activeLabels.push_back(i);
+        else
+            restricted = true;
+    }
+}
+
+// Check if the online n-best is confident enough to skip the offline classifier
+bool SymRec::onlineSuffices(std::span<const std::pair<float, int>> clason) const
+{
+    if (cascadeTH > 0 && clason[0].first > cascadeTH)
+        return true;
+    if (cascadeMargin > 0 && clason.size() > 1 && clason[0].first - clason[1].first > cascadeMargin)
+        return true;
+    return false;
+}
+
+// Run a task on the executor, or on a new thread if none was supplied
+std::future<void> SymRec::launch(std::function<void()> task)
+{
+    if (!exec)
+        return std::async(std::launch::async, std::move(task));
+
+    auto job = std::make_shared<std::packaged_task<void()>>(std::move(task));
+    auto done = job->get_future();
+    exec([job] { (*job)(); });
+    return done;
+}
+
 /************
  * Classify *
  ************/
@@ -289,34 +352,14 @@ int SymRec::classify(Samples& M, SegmentHyp& SegHyp, const int NB, int* vclase,
         regy = std::min(regy, cur_stroke.ry);
         regt = std::max(regt, cur_stroke.rt);
 
-        const int nPoints = cur_stroke.getNPoints();
-        for (int j = 0; j < nPoints; ++j) {
-            SegHyp.cen += cur_stroke.get(j)->y;
-        }
-        N += nPoints;
+        SegHyp.cen += cur_stroke.sy;
+        N += cur_stroke.getNPoints();
     }
 
     SegHyp.cen /= N;
     as = (SegHyp.cen + regt) / 2;
     ds = (regy + SegHyp.cen) / 2;
 
-    // Feature extraction of hypothesis
-    std::unique_ptr<DataSequence> feat_on, feat_off;
-
-    // Online features extraction: PRHLT (7 features)
-    feat_on = FEAS->getOnline(M, SegHyp);
-
-    // Render the image representing the set of strokes SegHyp.stks
-    {
-        VectorImage img;
-        M.renderStrokesPBM(SegHyp.stks, img);
-
-        // Offline features extraction: FKI (9 features)
-        feat_off = FEAS->getOfflineFKI(img, img.height, img.width);
-    }
-
-    // std::cout << feat_off->inputs;
-
     // n-best classification
     std::vector<std::pair<float, int>> clason(NB), clasoff(NB), clashyb(2 * NB);
 
@@ -329,9 +372,76 @@ int SymRec::classify(Samples& M, SegmentHyp& SegHyp, const int NB, int* vclase,
         clashyb[i].second = -1;
     }
 
+    // Both branches only read the sample and have their own network,
+    // so they can run at the same time until the n-best combination
+    using clock = std::chrono::steady_clock;
+    clock::duration online_time{}, offline_time{};
+
+    auto online = [&] {
+        const auto start = clock::now();
+
+        // Online features extraction: PRHLT (7 features)
+        const auto feat_on = FEAS->getOnline(M, SegHyp);
+        BLSTMclassification(blstm_on.get(), *feat_on, clason);
+
+        online_time = clock::now() - start;
+    };
+    auto offline = [&] {
+        const auto start = clock::now();
+
+        // Render the image representing the set of strokes SegHyp.stks
+        VectorImage img;
+        M.renderStrokesPBM(SegHyp.stks, img);
+
+        // Offline features extraction: FKI (9 features)
+        const auto feat_off = FEAS->getOfflineFKI(img, img.height, img.width);
+        BLSTMclassification(blstm_off.get(), *feat_off, clasoff);
+
+        offline_time = clock::now() - start;
+    };
+
+    ++stats.classifications;
+
     // Online/offline classification
-    BLSTMclassification(blstm_on.get(), *feat_on, clason);
-    BLSTMclassification(blstm_off.get(), *feat_off, clasoff);
+    bool skip_offline = false;
+    if (cascadeTH <= 0 && cascadeMargin <= 0) {
+        if (concurrent) {
+            auto offline_done = launch(offline);
+            try {
+                online();
+            } catch (...) {
+                // The offline task still references this frame
+                offline_done.wait();
+                throw;
+            }
+            offline_done.get();
+        } else {
+            online();
+            offline();
+        }
+    } else {
+        // The cascade needs the online result before deciding on the offline one
+        online();
+        skip_offline = onlineSuffices(clason);
+        if (!skip_offline || cascadeAudit)
+            offline();
+    }
+
+    stats.online_time += online_time;
+    stats.offline_time += offline_time;
+
+    if (skip_offline && !cascadeAudit) {
+        ++stats.offline_skipped;
+
+        // Without offline evidence, assume it agrees with the online classifier:
+        // alpha * pr(on) + (1 - alpha) * pr(on) = pr(on)
+        for (int i = 0; i < NB; i++) {
+            vpr[i] = clason[i].first;
+            vclase[i] = clason[i].second;
+        }
+
+        return SegHyp.cen;
+    }
 
     // Online + Offline n-best linear combination
     // alpha * pr(on) + (1 - alpha) * pr(off)
@@ -374,7 +484,15 @@ int SymRec::classify(Samples& M, SegmentHyp& SegHyp, const int NB, int* vclase,
     }
 
     std::sort(&clashyb[0], &clashyb[hybnext], std::greater<std::pair<float, int>>());
-    for (int i = 0, e = std::min<int>(hybnext, NB); i < e; i++) {
+
+    if (skip_offline) {
+        // Audit mode: the decision is counted but the combined result is used
+        ++stats.offline_skipped;
+        ++stats.cascade_audited;
+        if (clason[0].second == clashyb[0].second)
+            ++stats.cascade_agreed;
+    }
+    for (int i = 0; i < NB; i++) {
         vpr[i] = clashyb[i].first;
         vclase[i] = clashyb[i].second;
     }
@@ -392,25 +510,42 @@ void SymRec::BLSTMclassification(Mdrnn* net, const DataSequence& seq, std::span<
     int NVEC = L->outputActivations.shape[0];
     const int NCLA = L->outputActivations.shape[1];
 
-    auto prob_class = std::make_unique<std::pair<float, int>[]>(NCLA);
-    for (int i = 0; i < NCLA; i++) {
+    // Only the allowed outputs are ranked
+    const int NACT = activeLabels.size();
+    auto prob_class = std::make_unique<std::pair<float, int>[]>(NACT);
+    for (int i = 0; i < NACT; i++) {
         auto& p_c = prob_class[i];
         p_c.first = 0.0;
-        p_c.second = cl2key[header_on.targetLabels[i]]; // targetLabels on = targetLabels off
+        p_c.second = label2key[activeLabels[i]]; // targetLabels on = targetLabels off
     }
 
-    // Compute the average posterior probability per class
-    for (int nvec = 0; nvec < NVEC; nvec++)
-        for (int ncla = 0; ncla < NCLA; ncla++)
-            prob_class[ncla].first += L->outputActivations.data[nvec * NCLA + ncla];
+    // Compute the average posterior probability per class. With a restricted
+    // vocabulary every frame is renormalized over the allowed classes, which is
+    // the softmax over their activations alone
+    for (int nvec = 0; nvec < NVEC; nvec++) {
+        const auto* frame = &L->outputActivations.data[nvec * NCLA];
+
+        double norm = 1.0;
+        if (restricted) {
+            norm = 0.0;
+            for (int i = 0; i < NACT; i++)
+                norm += frame[activeLabels[i]];
+            if (norm <= 0.0)
+                norm = 1.0;
+        }
+
+        for (int i = 0; i < NACT; i++)
+            prob_class[i].first += frame[activeLabels[i]] / norm;
+    }
 
-    for (int ncla = 0; ncla < NCLA; ncla++)
-        prob_class[ncla].first /= NVEC;
+    for (int i = 0; i < NACT; i++)
+        prob_class[i].first /= NVEC;
 
     // Sort classification result by its probability
-    std::span<std::pair<float, int>> prob_class_span(prob_class.get(), NCLA);
+    std::span<std::pair<float, int>> prob_class_span(prob_class.get(), NACT);
     std::sort(prob_class_span.begin(), prob_class_span.end(), std::greater<std::pair<float, int>>());
 
-    // Copy n-best to output vector
-    std::copy_n(prob_class_span.begin(), claspr.size(), claspr.begin());
+    // Copy n-best to output vector (fewer allowed classes leave empty entries)
+    const auto it = std::copy_n(prob_class_span.begin(), std::min(claspr.size(), prob_class_span.size()), claspr.begin());
+    std::fill(it, claspr.end(), std::pair<float, int>(0.0, -1));
 }
@@ -21,19 +21,6 @@
 #include <utility>
 #include <vector>
 
-namespace std {
-
-void swap(seshat::InternalOptHypothesis& a, seshat::InternalOptHypothesis& b)
-{
-    seshat::InternalHypothesis tmp(-1, -FLT_MAX, nullptr, -1);
-    std::swap(a.pm_comps, b.pm_comps);
-    tmp.copy(*a.Target);
-    a.Target->copy(*b.Target);
-    b.Target->copy(tmp);
-}
-
-}
-
 using namespace seshat;
 
 TableCYK::TableCYK(int n, int k)
@@ -54,29 +41,19 @@ TableCYK::~TableCYK()
     }
 }
 
-InternalHypothesis* TableCYK::getMLH(int n)
+void TableCYK::SetNumHypotheses(int amount)
 {
-    if (n >= (int)Targets.size())
-        return nullptr;
-
-    if (!Targets[n].Target)
-        return nullptr;
-
-    return &Targets[n].Target.value();
+    nhyps = amount;
 }
 
-void TableCYK::SetNumHypotheses(int amount)
+int TableCYK::NumHypotheses() const
 {
-    Targets.clear();
-    Targets.resize(amount);
-    for (auto& hyp : Targets) {
-        hyp.Target.emplace(-1, -FLT_MAX, nullptr, -1);
-        hyp.pm_comps = 0;
-    }
+    return nhyps;
 }
-int TableCYK::NumHypotheses() const
+
+bool TableCYK::keepsAlternatives() const
 {
-    return Targets.size();
+    return nhyps > 1;
 }
 
 CellCYK* TableCYK::get(int n)
@@ -89,21 +66,7 @@ int TableCYK::size(int n)
     return TS[n - 1].size();
 }
 
-void TableCYK::updateTarget(const InternalHypothesis& H)
-{
-    const int pcomps = std::count(&H.parent->ccc[0], &H.parent->ccc[0] + H.parent->nc, true);
-
-    for (auto it = Targets.begin(); it != Targets.end(); ++it) {
-        if (pcomps > it->pm_comps || (pcomps == it->pm_comps && H.pr > it->Target->pr)) {
-            std::rotate(it, it + 1, Targets.end());
-            it->Target->copy(H);
-            it->pm_comps = pcomps;
-            break;
-        }
-    }
-}
-
-void TableCYK::add(int n, CellCYK* celda, int noterm_id, bool* esinit)
+void TableCYK::add(int n, CellCYK* celda, int noterm_id)
 {
     coo key(celda->x, celda->y, celda->s, celda->t);
     auto& containing_map = TS[n - 1];
@@ -116,43 +79,22 @@ void TableCYK::add(int n, CellCYK* celda, int noterm_id, bool* esinit)
         celda->sig = T[n - 1];
         T[n - 1] = celda;
         containing_map[key] = celda;
-
-        if (noterm_id >= 0) {
-            if (esinit[noterm_id]) {
-                updateTarget(*celda->noterm[noterm_id]);
-            }
-        } else {
-            for (int nt = 0; nt < celda->nnt; nt++) {
-                if (celda->noterm[nt] && esinit[nt]) {
-                    updateTarget(*celda->noterm[nt]);
-                }
-            }
-        }
     } else { // Maximize probability avoiding duplicates
 
-        int VA, VB;
-        if (noterm_id < 0) {
-            VA = 0;
-            VB = celda->nnt;
-        } else {
-            VA = noterm_id;
-            VB = VA + 1;
-        }
-
         CellCYK* r = it->second;
 
         if (!celda->ccEqual(r)) {
             // The cells cover the same region with a different set of strokes
 
             float maxpr_c = -FLT_MAX;
-            for (int i = VA; i < VB; i++)
-                if (celda->noterm[i] && celda->noterm[i]->pr > maxpr_c)
-                    maxpr_c = celda->noterm[i]->pr;
+            for (const auto& [nt, H] : celda->noterm)
+                if ((noterm_id < 0 || nt == noterm_id) && H.pr > maxpr_c)
+                    maxpr_c = H.pr;
 
             float maxpr_r = -FLT_MAX;
-            for (int i = 0; i < r->nnt; i++)
-                if (r->noterm[i] && r->noterm[i]->pr > maxpr_r)
-                    maxpr_r = r->noterm[i]->pr;
+            for (const auto& [nt, H] : r->noterm)
+                if (H.pr > maxpr_r)
+                    maxpr_r = H.pr;
 
             // If the new cell contains the most likely hypothesis, replace the hypotheses
             if (maxpr_c > maxpr_r) {
@@ -161,24 +103,21 @@ void TableCYK::add(int n, CellCYK* celda, int noterm_id, bool* esinit)
                 for (int i = 0; i < celda->nc; i++)
                     r->ccc[i] = celda->ccc[i];
 
+                // Remove the hypotheses of non-terminals the new cell doesn't have
+                for (int i = 0; i < r->nnt; i++) {
+                    if (r->noterm[i] && !celda->noterm[i])
+                        r->noterm.erase(i);
+                }
+
                 // Replace the hypotheses for each non-terminal
-                for (int i = 0; i < celda->nnt; i++) {
-                    if (celda->noterm[i]) {
-                        if (r->noterm[i]) {
-                            r->noterm[i]->copy(*celda->noterm[i]);
-                        } else {
-                            r->noterm[i] = std::move(celda->noterm[i]);
-
-                            // Set to NULL such that the "delete celda" doesn't delete the hypothesis
-                            celda->noterm[i] = nullptr;
-                        }
-
-                        r->noterm[i]->parent = r;
-                        if (esinit[i])
-                            updateTarget(*r->noterm[i]);
-                    } else if (r->noterm[i]) {
-                        r->noterm[i].reset();
-                    }
+                for (auto& [nt, H] : celda->noterm.take()) {
+                    InternalHypothesis* rh = r->noterm[nt];
+                    if (rh)
+                        rh->copy(H);
+                    else
+                        rh = r->noterm.set(nt, H);
+
+                    rh->parent = r;
                 }
             }
 
@@ -188,31 +127,71 @@ void TableCYK::add(int n, CellCYK* celda, int noterm_id, bool* esinit)
             return;
         }
 
-        for (int i = VA; i < VB; i++) {
-            if (!celda->noterm[i])
+        for (auto& [nt, H] : celda->noterm.take()) {
+            if (noterm_id >= 0 && nt != noterm_id)
                 continue;
 
-            if (r->noterm[i]) {
-                if (celda->noterm[i]->pr > r->noterm[i]->pr) {
+            if (InternalHypothesis* rh = r->noterm[nt]) {
+                if (H.pr > rh->pr) {
                     // Maximize probability (replace)
-                    r->noterm[i]->copy(*celda->noterm[i]);
-                    r->noterm[i]->parent = r;
-
-                    if (esinit[i])
-                        updateTarget(*r->noterm[i]);
+                    Derivation* prev = rh->der;
+                    rh->copy(H);
+                    rh->parent = r;
+
+                    if (keepsAlternatives())
+                        rh->der->splice(prev);
+                } else if (keepsAlternatives()) {
+                    // Same strokes and non-terminal: an alternative derivation of rh
+                    rh->der->splice(H.der);
                 }
             } else {
-                r->noterm[i] = std::move(celda->noterm[i]);
-                r->noterm[i]->parent = r;
-
-                // Set to NULL such that the "delete celda" doesn't delete the hypothesis
-                celda->noterm[i] = nullptr;
-
-                if (esinit[i])
-                    updateTarget(*r->noterm[i]);
+                rh = r->noterm.set(nt, H);
+                rh->parent = r;
             }
         }
 
         delete celda;
     }
 }
+
+// Check if add() would discard a hypothesis of noterm_id with probability pr covering the
+// strokes of cells A and B, because its region already holds a more likely hypothesis
+bool TableCYK::rejects(int n, const CellCYK* A, const CellCYK* B, int noterm_id, float pr) const
+{
+    const coo key(std::min(A->x, B->x), std::min(A->y, B->y), std::max(A->s, B->s), std::max(A->t, B->t));
+    const auto& containing_map = TS[n - 1];
+    const auto it = containing_map.find(key);
+    if (it == containing_map.end())
+        return false;
+
+    const CellCYK* r = it->second;
+
+    bool same_strokes = true;
+    for (int i = 0; i < r->nc && same_strokes; i++)
+        same_strokes = r->ccc[i] == (A->ccc[i] || B->ccc[i]);
+
+    // Same set of strokes: compared against the same non-terminal, unless it would be kept as
+    // an alternative derivation
+    if (same_strokes)
+        return !keepsAlternatives() && r->noterm[noterm_id] && r->noterm[noterm_id]->pr >= pr;
+
+    // Different set of strokes: the new cell needs the most likely hypothesis of the region
+    for (const auto& [nt, H] : r->noterm)
+        if (H.pr >= pr)
+            return true;
+
+    return false;
+}
+
+std::vector<const InternalHypothesis*> TableCYK::roots(const bool* esinit) const
+{
+    std::vector<const InternalHypothesis*> out;
+
+    for (const auto tcell : T)
+        for (const CellCYK* c = tcell; c; c = c->sig)
+            for (const auto& [nt, H] : c->noterm)
+                if (esinit[nt])
+                    out.push_back(&H);
+
+    return out;
+}